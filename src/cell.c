@@ -17,12 +17,19 @@ phx_extents_reset(phx_extents_t *ext) {
 	ext->max.y = -INFINITY;
 }
 
-void
+/**
+ * Grow extents to include other extents.
+ *
+ * @return `true` if the extents changed, `false` otherwise.
+ */
+bool
 phx_extents_include(phx_extents_t *ext, phx_extents_t *other) {
-	if (other->min.x < ext->min.x) ext->min.x = other->min.x;
-	if (other->min.y < ext->min.y) ext->min.y = other->min.y;
-	if (other->max.x > ext->max.x) ext->max.x = other->max.x;
-	if (other->max.y > ext->max.y) ext->max.y = other->max.y;
+	bool changed = false;
+	if (other->min.x < ext->min.x) { ext->min.x = other->min.x; changed = true; }
+	if (other->min.y < ext->min.y) { ext->min.y = other->min.y; changed = true; }
+	if (other->max.x > ext->max.x) { ext->max.x = other->max.x; changed = true; }
+	if (other->max.y > ext->max.y) { ext->max.y = other->max.y; changed = true; }
+	return changed;
 }
 
 void
@@ -39,15 +46,27 @@ phx_library_t *
 phx_library_create(phx_tech_t *tech) {
 	phx_library_t *lib = calloc(1, sizeof(*lib));
 	lib->tech = tech;
+	lib->dbu = PHX_DEFAULT_DBU;
+	lib->num_threads = 1;
 	array_init(&lib->cells, sizeof(phx_cell_t*));
+	strmap_init(&lib->cells_by_name);
+	array_init(&lib->dirty, sizeof(phx_cell_t*));
+	array_init(&lib->edited, sizeof(phx_cell_t*));
 	return lib;
 }
 
 void
 phx_library_destroy(phx_library_t *lib) {
 	assert(lib);
+	phx_library_stop_trace(lib);
+	phx_library_stop_pool(lib);
 	for (size_t z = 0; z < lib->cells.size; z++)
 		free_cell(array_at(lib->cells, phx_cell_t*, z));
+	strmap_dispose(&lib->cells_by_name);
+	array_dispose(&lib->dirty);
+	array_dispose(&lib->edited);
+	if (lib->shapes)
+		phx_shape_table_destroy(lib->shapes);
 	free(lib);
 }
 
@@ -59,12 +78,9 @@ phx_cell_t *
 phx_library_find_cell(phx_library_t *lib, const char *name, bool create) {
 	phx_cell_t *cell;
 	assert(lib && name);
-	/// @todo Keep a sorted lookup table to increase the speed of this.
-	for (size_t z = 0; z < lib->cells.size; ++z) {
-		cell = array_at(lib->cells, phx_cell_t*, z);
-		if (strcmp(cell->name, name) == 0)
-			return cell;
-	}
+	cell = strmap_get(&lib->cells_by_name, name);
+	if (cell)
+		return cell;
 	if (create) {
 		cell = new_cell(lib, name);
 		return cell;
@@ -73,6 +89,79 @@ phx_library_find_cell(phx_library_t *lib, const char *name, bool create) {
 	}
 }
 
+/**
+ * Set the size of one database unit of the library, in meters. Since all
+ * geometry is stored in database units, this must happen before any geometry
+ * is added to the library's cells.
+ */
+void
+phx_library_set_dbu(phx_library_t *lib, double dbu) {
+	assert(lib && dbu > 0);
+	lib->dbu = dbu;
+	for (unsigned u = 0; u < lib->cells.size; ++u) {
+		phx_cell_t *cell = array_at(lib->cells, phx_cell_t*, u);
+		for (unsigned v = 0; v < cell->insts.size; ++v)
+			phx_inst_update_xform(array_at(cell->insts, phx_inst_t*, v));
+	}
+}
+
+/**
+ * Set the number of threads used to update the cells of the library. Cells on
+ * the same level of the hierarchy are updated concurrently, unless there are
+ * fewer of them than threads. The threads are started by the first update
+ * that needs them, and kept until the number changes or the library is
+ * destroyed. Defaults to 1.
+ */
+void
+phx_library_set_num_threads(phx_library_t *lib, unsigned num_threads) {
+	assert(lib && num_threads > 0);
+	if (lib->num_threads != num_threads)
+		phx_library_stop_pool(lib);
+	lib->num_threads = num_threads;
+}
+
+unsigned
+phx_library_get_num_threads(phx_library_t *lib) {
+	assert(lib);
+	return lib->num_threads;
+}
+
+double
+phx_library_get_dbu(phx_library_t *lib) {
+	assert(lib);
+	return lib->dbu;
+}
+
+/**
+ * Convert a length in meters to the nearest integer number of database units.
+ */
+int32_t
+phx_library_to_dbu(phx_library_t *lib, double v) {
+	assert(lib);
+	return lround(v / lib->dbu);
+}
+
+/**
+ * Convert a length in database units to meters.
+ */
+double
+phx_library_from_dbu(phx_library_t *lib, int32_t v) {
+	assert(lib);
+	return v * lib->dbu;
+}
+
+vec2i_t
+phx_library_vec_to_dbu(phx_library_t *lib, vec2_t v) {
+	assert(lib);
+	return VEC2I(lround(v.x / lib->dbu), lround(v.y / lib->dbu));
+}
+
+vec2_t
+phx_library_vec_from_dbu(phx_library_t *lib, vec2i_t v) {
+	assert(lib);
+	return VEC2(v.x * lib->dbu, v.y * lib->dbu);
+}
+
 
 
 phx_cell_t *
@@ -80,16 +169,22 @@ new_cell(phx_library_t *lib, const char *name) {
 	assert(lib && name);
 	phx_cell_t *cell = calloc(1, sizeof(*cell));
 	cell->lib = lib;
-	cell->name = dupstr(name);
+	cell->name = intern_str(name);
 	cell->invalid = PHX_INIT_INVALID;
+	cell->dirty = true;
 	array_init(&cell->insts, sizeof(phx_inst_t*));
 	array_init(&cell->pins, sizeof(phx_pin_t*));
+	strmap_init(&cell->insts_by_name);
+	strmap_init(&cell->pins_by_name);
 	array_init(&cell->nets, sizeof(phx_net_t*));
 	array_init(&cell->arcs, sizeof(phx_timing_arc_t));
 	array_init(&cell->gds_text, sizeof(phx_gds_text_t*));
 	ptrset_init(&cell->uses);
 	phx_geometry_init(&cell->geo, cell);
+	phx_index_init(&cell->inst_index);
 	array_add(&lib->cells, &cell);
+	array_add(&lib->dirty, &cell);
+	strmap_add(&lib->cells_by_name, cell->name, cell);
 	return cell;
 }
 
@@ -108,8 +203,14 @@ free_cell(phx_cell_t *cell) {
 	for (unsigned u = 0; u < cell->gds_text.size; ++u) {
 		free(array_at(cell->gds_text, phx_gds_text_t*, u));
 	}
-	free(cell->name);
+	strmap_dispose(&cell->insts_by_name);
+	strmap_dispose(&cell->pins_by_name);
 	phx_geometry_dispose(&cell->geo);
+	phx_index_dispose(&cell->inst_index);
+	if (cell->flat) {
+		phx_geometry_dispose(cell->flat);
+		free(cell->flat);
+	}
 	array_dispose(&cell->insts);
 	array_dispose(&cell->pins);
 	array_dispose(&cell->nets);
@@ -131,7 +232,9 @@ void
 phx_cell_set_origin(phx_cell_t *cell, vec2_t o) {
 	assert(cell);
 	cell->origin = o;
-	phx_cell_invalidate(cell, PHX_EXTENTS);
+	for (unsigned u = 0; u < cell->uses.size; ++u)
+		phx_inst_update_xform(cell->uses.items[u]);
+	phx_cell_invalidate(cell, PHX_EXTENTS | PHX_FLAT);
 }
 
 void
@@ -175,28 +278,59 @@ phx_pin_t *
 cell_find_pin(phx_cell_t *cell, const char *name) {
 	phx_pin_t *pin;
 	assert(cell && name);
-	for (size_t z = 0, zn = cell->pins.size; z < zn; ++z) {
-		pin = array_at(cell->pins, phx_pin_t*, z);
-		if (strcmp(pin->name, name) == 0)
-			return pin;
-	}
+	pin = strmap_get(&cell->pins_by_name, name);
+	if (pin)
+		return pin;
 
 	pin = new_pin(cell, name);
 	array_add(&cell->pins, &pin);
+	strmap_add(&cell->pins_by_name, pin->name, pin);
 	return pin;
 }
 
 
+/**
+ * Raise the level of a cell such that it lies above a newly instantiated
+ * cell, and raise the level of all cells that instantiate it accordingly.
+ */
+static void
+raise_level(phx_cell_t *cell, unsigned level) {
+	if (cell->level >= level)
+		return;
+	cell->level = level;
+	array_t stack;
+	array_init(&stack, sizeof(phx_cell_t*));
+	for (;;) {
+		for (unsigned u = 0; u < cell->uses.size; ++u) {
+			phx_cell_t *parent = ((phx_inst_t*)cell->uses.items[u])->parent;
+			if (parent->level <= cell->level) {
+				parent->level = cell->level + 1;
+				array_add(&stack, &parent);
+			}
+		}
+		if (stack.size == 0)
+			break;
+		cell = array_at(stack, phx_cell_t*, --stack.size);
+	}
+	array_dispose(&stack);
+}
+
+
 phx_inst_t *
 new_inst(phx_cell_t *into, phx_cell_t *cell, const char *name) {
 	assert(into && cell);
 	phx_inst_t *inst = calloc(1, sizeof(*inst));
 	inst->cell = cell;
 	inst->parent = into;
-	inst->name = dupstr(name);
+	inst->name = intern_str(name);
 	inst->invalid = PHX_INIT_INVALID;
 	ptrset_add(&cell->uses, inst);
 	array_add(&into->insts, &inst);
+	if (inst->name)
+		strmap_add(&into->insts_by_name, inst->name, inst);
+	raise_level(into, cell->level + 1);
+	phx_inst_update_xform(inst);
+	phx_cell_invalidate(into, PHX_INIT_INVALID);
 	return inst;
 }
 
@@ -204,7 +338,6 @@ void
 free_inst(phx_inst_t *inst) {
 	assert(inst);
 	ptrset_remove(&inst->cell->uses, inst);
-	if (inst->name) free(inst->name);
 	free(inst);
 }
 
@@ -212,7 +345,8 @@ void
 inst_set_pos(phx_inst_t *inst, vec2_t pos) {
 	assert(inst);
 	inst->pos = pos;
-	phx_inst_invalidate(inst, PHX_EXTENTS);
+	phx_inst_update_xform(inst);
+	phx_inst_invalidate(inst, PHX_EXTENTS | PHX_FLAT);
 }
 
 vec2_t
@@ -234,7 +368,7 @@ new_pin(phx_cell_t *cell, const char *name) {
 	assert(cell && name);
 	phx_pin_t *pin = calloc(1, sizeof(*cell));
 	pin->cell = cell;
-	pin->name = dupstr(name);
+	pin->name = intern_str(name);
 	phx_geometry_init(&pin->geo, pin->cell);
 	return pin;
 }
@@ -242,7 +376,6 @@ new_pin(phx_cell_t *cell, const char *name) {
 static void
 free_pin(phx_pin_t *pin) {
 	assert(pin);
-	free(pin->name);
 	phx_geometry_dispose(&pin->geo);
 	free(pin);
 }
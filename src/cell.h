@@ -2,6 +2,7 @@
 #pragma once
 #include "common.h"
 #include "util.h"
+#include <pthread.h>
 
 
 /**
@@ -14,9 +15,18 @@ enum {
 	PHX_POWER_LKG    = 1 << 3,
 	PHX_POWER_INT    = 1 << 4,
 	PHX_ALL_BITS     = 0x1F,
-	PHX_INIT_INVALID = PHX_ALL_BITS,
+	/// The spatial index of a layer or of a cell's instances. Only tracked
+	/// locally and never propagated to parents.
+	PHX_INDEX        = 1 << 5,
+	/// The flattened geometry of a cell. Only recalculated when requested
+	/// explicitly, and therefore not part of PHX_ALL_BITS.
+	PHX_FLAT         = 1 << 6,
+	PHX_INIT_INVALID = PHX_ALL_BITS | PHX_INDEX | PHX_FLAT,
 };
 
+/// The default database unit of a library, in meters.
+#define PHX_DEFAULT_DBU 1e-9
+
 struct phx_extents {
 	vec2_t min;
 	vec2_t max;
@@ -25,8 +35,40 @@ struct phx_extents {
 struct phx_library {
 	/// The technology the cells in this library are implemented in.
 	phx_tech_t *tech;
+	/// The size of one database unit, in meters. All geometry in the library
+	/// is stored as integer multiples of this unit.
+	double dbu;
 	/// The cells in this library.
 	array_t cells; /* phx_cell_t* */
+	/// The cells in this library by name. If several cells have the same
+	/// name, the one created first is found.
+	strmap_t cells_by_name; /* phx_cell_t* */
+	/// The canonical shapes of all geometry in the library, or `NULL` if
+	/// shapes are not interned. See phx_library_intern_shapes.
+	phx_shape_table_t *shapes;
+	/// The cells that became invalid since the last phx_library_update, in
+	/// no particular order. See phx_cell_t::dirty.
+	array_t dirty; /* phx_cell_t* */
+	/// Incremented for every walk down the hierarchy, to mark the cells that
+	/// have already been visited. See phx_cell_t::visited.
+	unsigned visit_mark;
+	/// The number of threads cells are updated with. See
+	/// phx_library_set_num_threads.
+	unsigned num_threads;
+	/// The threads that help the calling thread update the cells, started
+	/// by the first update that needs them, or `NULL`.
+	phx_update_pool_t *pool;
+	/// Whether the cells of a level are being updated by several threads.
+	/// The library's lists of cells must not change meanwhile.
+	bool parallel;
+	/// The number of edits currently open. See phx_library_begin_edit.
+	unsigned edit_depth;
+	/// The cells changed during the current edit. See
+	/// phx_cell_t::edit_bits.
+	array_t edited; /* phx_cell_t* */
+	/// The updates recorded while the library is traced, or `NULL`. See
+	/// phx_library_start_trace.
+	phx_trace_t *trace;
 };
 
 struct phx_geometry {
@@ -34,10 +76,83 @@ struct phx_geometry {
 	uint8_t invalid;
 	/// The cell that contains this geometry.
 	phx_cell_t *cell;
-	/// The layers this geometry contains information for.
+	/// The layers this geometry contains information for, in the order they
+	/// were created.
 	array_t layers; /* phx_layer_t */
+	/// Maps the index of a technology layer to the position of the
+	/// corresponding layer in @a layers plus one, or 0 if the geometry has no
+	/// such layer. Grown as layers are added.
+	unsigned *layer_map;
+	unsigned layer_map_size;
+	/// Shared geometry placed into this geometry, in addition to the layers
+	/// above. See phx_geometry_add_shared.
+	array_t refs; /* phx_geometry_ref_t */
 	/// The extents of the geometry.
 	phx_extents_t ext;
+	/// The memory the lines and shapes of all layers are allocated from.
+	pool_t pool;
+};
+
+/**
+ * An axis-aligned rectangle, in database units.
+ */
+struct phx_rect {
+	vec2i_t min;
+	vec2i_t max;
+};
+
+/**
+ * A list of axis-aligned rectangles. The coordinates are stored in separate
+ * arrays, such that loops over all rectangles operate on contiguous memory.
+ */
+struct phx_rects {
+	/// The number of rectangles in the list.
+	unsigned size;
+	/// The number of rectangles the arrays can hold.
+	unsigned capacity;
+	/// The coordinates of the rectangles. The four arrays share one
+	/// allocation.
+	int32_t *xmin;
+	int32_t *ymin;
+	int32_t *xmax;
+	int32_t *ymax;
+};
+
+/// The maximum number of children of a node in a spatial index.
+#define PHX_INDEX_FANOUT 16
+/// The maximum number of levels in a spatial index. Sufficient to hold
+/// 2^32 items at the above fanout.
+#define PHX_INDEX_MAX_LEVELS 9
+
+/**
+ * A bulk-loaded R-tree over rectangles, packed with the Sort-Tile-Recursive
+ * algorithm. The nodes of each level are stored contiguously, such that node
+ * `i` of a level covers the nodes `i*PHX_INDEX_FANOUT` up to
+ * `(i+1)*PHX_INDEX_FANOUT-1` of the level below. The lowest level holds the
+ * items themselves.
+ */
+struct phx_index {
+	/// The number of items in the index.
+	unsigned num_items;
+	/// The number of levels in the tree, including the items.
+	unsigned num_levels;
+	/// The offset of the first box of each level into @a boxes, and the
+	/// number of boxes on that level. Level 0 holds the items.
+	unsigned level_start[PHX_INDEX_MAX_LEVELS];
+	unsigned level_size[PHX_INDEX_MAX_LEVELS];
+	/// The bounding boxes of all nodes on all levels.
+	phx_rect_t *boxes;
+	/// The caller-provided identifiers of the items, in tree order.
+	uint32_t *ids;
+};
+
+/**
+ * The kinds of geometry reported by a layer query.
+ */
+enum phx_layer_item {
+	PHX_LAYER_RECT  = 0,
+	PHX_LAYER_SHAPE = 1,
+	PHX_LAYER_LINE  = 2,
 };
 
 struct phx_layer {
@@ -47,33 +162,54 @@ struct phx_layer {
 	phx_geometry_t *geo;
 	/// The technology layer this layer corresponds to.
 	phx_tech_layer_t *tech;
-	/// The lines on this layer.
+	/// The lines on this layer, allocated from the geometry's pool.
 	array_t lines; /* phx_line_t* */
-	/// The shapes on this layer.
-	array_t shapes; /* phx_shape_t* */
+	/// The shapes on this layer, allocated from the geometry's pool or
+	/// interned by the library. Only holds shapes that are not axis-aligned
+	/// rectangles.
+	array_t shapes; /* phx_shape_ref_t */
+	/// The axis-aligned rectangles on this layer.
+	phx_rects_t rects;
 	/// The layer's extents.
 	phx_extents_t ext;
+	/// The spatial index over the rectangles, shapes, and lines on this
+	/// layer. Built lazily upon the first query after a modification.
+	phx_index_t index;
 };
 
 struct phx_line {
-	/// The width of the line, in meters.
-	double width;
+	/// The width of the line, in database units.
+	int32_t width;
 	/// The number of points in the line. Must be at least 2.
 	uint16_t num_pts;
-	/// The points in the line.
-	vec2_t pts[];
+	/// The points in the line, in database units.
+	vec2i_t pts[];
 };
 
 struct phx_shape {
 	/// Number of points in the shape.
 	uint16_t num_pts;
-	/// The points in the shape.
-	vec2_t pts[];
+	/// Whether the shape is owned by the library's table of interned shapes.
+	bool interned;
+	/// The points in the shape, in database units.
+	vec2i_t pts[];
+};
+
+/**
+ * A shape placed on a layer. The points of the shape are relative to @a off.
+ * Interned shapes are translated such that their lowest point lies at the
+ * origin, and are shared by all layers that contain the same shape at any
+ * position.
+ */
+struct phx_shape_ref {
+	phx_shape_t *shape;
+	vec2i_t off;
 };
 
 struct phx_pin {
 	phx_cell_t *cell;
-	char *name;
+	/// The pin's name, interned. See intern_str.
+	const char *name;
 	phx_geometry_t geo;
 	double capacitance;
 };
@@ -81,22 +217,39 @@ struct phx_pin {
 struct phx_cell {
 	/// The bits of this cell that need to be recalculated.
 	uint8_t invalid;
+	/// Whether the cell is on the library's list of dirty cells.
+	bool dirty;
+	/// The cell's level in the hierarchy. Zero for cells without instances,
+	/// and otherwise larger than the level of every instantiated cell.
+	unsigned level;
+	/// The library's visit mark at the last time the cell was visited.
+	unsigned visited;
+	/// The bits of this cell that changed during the current edit, and that
+	/// are yet to be invalidated in the cells further up the hierarchy.
+	uint8_t edit_bits;
+	/// The cell's update counters while the library is traced, or `NULL`.
+	phx_trace_cell_t *trace;
 	/// The library this cell is part of.
 	phx_library_t *lib;
-	/// The cell's name.
-	char *name;
+	/// The cell's name, interned. See intern_str.
+	const char *name;
 	/// The cell's origin, in meters.
 	vec2_t origin;
 	/// The cell's size, in meters.
 	vec2_t size;
 	/// Instances contained within this cell.
 	array_t insts;
+	/// The named instances by name. If several instances have the same name,
+	/// the one created first is found.
+	strmap_t insts_by_name; /* phx_inst_t* */
 	/// The cell's extents.
 	phx_extents_t ext;
 	/// The cell's geometry.
 	phx_geometry_t geo;
 	/// The cell's pins.
 	array_t pins; /* phx_pin_t* */
+	/// The cell's pins by name.
+	strmap_t pins_by_name; /* phx_pin_t* */
 	/// The cell's nets.
 	array_t nets; /* phx_net_t* */
 	/// The cell's timing arcs.
@@ -109,6 +262,13 @@ struct phx_cell {
 	ptrset_t uses;
 	/// Manually created GDS text elements.
 	array_t gds_text;
+	/// The spatial index over the extents of the cell's instances. Built
+	/// lazily upon the first region query after an instance changed.
+	phx_index_t inst_index;
+	/// The cell's geometry with the geometry of its pins and of all instances
+	/// merged in, or `NULL` if it has not been requested yet or the cell has
+	/// no instances. See phx_cell_get_flat_layers.
+	phx_geometry_t *flat;
 };
 
 enum phx_orientation {
@@ -122,6 +282,46 @@ enum phx_orientation {
 	PHX_ROTATE_270 = PHX_ROTATE_90 | PHX_ROTATE_180,
 };
 
+/**
+ * A transformation between the coordinate spaces of an instance and its
+ * parent, in database units. Maps a point `p` to `M*p + off`, where the matrix
+ * `M = [xx xy; yx yy]` is one of the eight orientations an instance may have.
+ */
+struct phx_xform {
+	int32_t xx, xy;
+	int32_t yx, yy;
+	vec2i_t off;
+};
+
+/**
+ * A block of geometry that is shared among several geometries and is never
+ * modified. Released when the last reference to it is dropped.
+ */
+struct phx_geometry_block {
+	/// The number of references to this block.
+	unsigned refs;
+	/// The shared geometry. Its `refs` array is always empty.
+	phx_geometry_t geo;
+};
+
+/**
+ * A reference from a geometry to a shared block, placed with a
+ * transformation into the referencing geometry's coordinate space.
+ */
+struct phx_geometry_ref {
+	phx_geometry_block_t *block;
+	phx_xform_t xf;
+};
+
+/**
+ * A layer of the flattened geometry of a cell, placed with a transformation
+ * into the cell's coordinate space. See phx_cell_get_flat_layers.
+ */
+struct phx_flat_layer {
+	phx_layer_t *layer;
+	phx_xform_t xf;
+};
+
 struct phx_inst {
 	/// Invalidated bits of the instance.
 	uint8_t invalid;
@@ -131,12 +331,15 @@ struct phx_inst {
 	phx_cell_t *parent;
 	/// The instance's orientation.
 	uint8_t orientation; /* enum phx_orientation */
-	/// The instance name.
-	char *name;
+	/// The instance name, interned. See intern_str.
+	const char *name;
 	/// The position of the cell's origin.
 	vec2_t pos;
 	/// The instance's extents.
 	phx_extents_t ext;
+	/// The transformation from the instance's to the parent's coordinate
+	/// space. Kept up to date with the position and orientation.
+	phx_xform_t xform;
 };
 
 struct phx_terminal {
@@ -144,6 +347,135 @@ struct phx_terminal {
 	phx_pin_t *pin;
 };
 
+/**
+ * A terminal found by connectivity extraction, together with the group of
+ * electrically connected geometry it belongs to.
+ */
+struct phx_extracted_terminal {
+	phx_terminal_t term;
+	unsigned group;
+};
+
+/**
+ * A violation of a technology layer's minimum width or spacing, found by
+ * phx_cell_check_spacing.
+ */
+struct phx_spacing_violation {
+	/// The layer the violation occurred on.
+	phx_tech_layer_t *layer;
+	/// The instances the offending geometry belongs to, or `NULL` for the
+	/// cell's own geometry. Width violations only involve @a inst_a.
+	phx_inst_t *inst_a;
+	phx_inst_t *inst_b;
+	/// The bounding boxes of the offending geometry, in database units.
+	phx_rect_t box_a;
+	phx_rect_t box_b;
+	/// The width of the geometry, or the distance between the two pieces of
+	/// geometry, in database units.
+	int32_t measured;
+	/// Whether the geometry is too narrow, as opposed to too close.
+	bool width;
+};
+
+/**
+ * The memory held by a library, in bytes, broken down by what it is used for.
+ * See phx_library_memory_report.
+ */
+struct phx_memory_report {
+	/// The cells, instances, pins, nets, and timing arcs, excluding geometry
+	/// and tables.
+	size_t cells;
+	/// The geometry of all cells and pins, including shared blocks and
+	/// spatial indices.
+	size_t geometry;
+	/// The timing tables. Tables shared by several arcs are counted once.
+	size_t tables;
+	/// The shapes interned by the library.
+	size_t shapes;
+	/// The interned names. These are shared by all libraries.
+	size_t names;
+	/// The raw GDS structures kept by cells loaded from GDS, and the number
+	/// of elements they hold. These are opaque to us and their memory is not
+	/// included in the figures above.
+	unsigned num_gds;
+	unsigned num_gds_elems;
+	/// The memory held by each cell, including its geometry and the shared
+	/// blocks it was first to reference, in the order of the library's cells.
+	array_t by_cell; /* size_t */
+	/// The memory held by the rectangles, shapes, lines, and spatial indices
+	/// on each layer, indexed by the technology layer's index.
+	array_t by_layer; /* size_t */
+};
+
+/**
+ * The kinds of updates recorded while a library is traced.
+ */
+enum phx_update_kind {
+	PHX_UPDATE_EXTENTS,
+	PHX_UPDATE_CAPACITANCES,
+	PHX_UPDATE_TIMING,
+	PHX_UPDATE_LEAKAGE,
+	PHX_UPDATE_FLAT,
+	PHX_UPDATE_NET_TIMING,
+	PHX_UPDATE_INST_INDEX,
+	PHX_NUM_UPDATE_KINDS,
+};
+
+struct phx_update_counter {
+	/// The number of times the update ran.
+	uint64_t calls;
+	/// The number of times the update was requested while the bits were
+	/// valid already.
+	uint64_t hits;
+	/// The time spent running the update, in nanoseconds. Includes the time
+	/// spent in updates nested within it.
+	uint64_t time_ns;
+};
+
+/**
+ * One run of an update, as recorded by a trace.
+ */
+struct phx_trace_event {
+	/// The cell that was updated.
+	phx_cell_t *cell;
+	uint8_t kind; /* enum phx_update_kind */
+	/// The thread that ran the update, numbered in order of appearance.
+	unsigned thread;
+	/// The start of the update relative to the start of the trace, and its
+	/// duration, in nanoseconds.
+	uint64_t start_ns;
+	uint64_t duration_ns;
+};
+
+/**
+ * The update counters of one cell, as recorded by a trace.
+ */
+struct phx_trace_cell {
+	phx_cell_t *cell;
+	phx_update_counter_t counters[PHX_NUM_UPDATE_KINDS];
+};
+
+/**
+ * The updates recorded while a library is traced. See
+ * phx_library_start_trace.
+ */
+struct phx_trace {
+	/// The time the trace was started, in nanoseconds.
+	uint64_t start_ns;
+	/// The counters of each kind of update, summed over all cells.
+	phx_update_counter_t counters[PHX_NUM_UPDATE_KINDS];
+	/// The counters of the cells updated or queried so far, in order of
+	/// their first appearance.
+	array_t cells; /* phx_trace_cell_t* */
+	/// Every update run, in the order they completed.
+	array_t events; /* phx_trace_event_t */
+	/// The threads that ran updates.
+	array_t threads; /* pthread_t */
+	/// Held while adding to the arrays above, since cells may be updated by
+	/// several threads at once.
+	pthread_mutex_t lock;
+};
+
 enum phx_timing_type {
 	PHX_TIM_DELAY,
 	PHX_TIM_TRANS,
@@ -165,13 +497,33 @@ struct phx_gds_text {
 
 
 void phx_extents_reset(phx_extents_t*);
-void phx_extents_include(phx_extents_t*, phx_extents_t*);
+bool phx_extents_include(phx_extents_t*, phx_extents_t*);
 void phx_extents_add(phx_extents_t*, vec2_t);
 
 /* Library */
 phx_library_t *phx_library_create(phx_tech_t*);
 void phx_library_destroy(phx_library_t*);
 phx_cell_t *phx_library_find_cell(phx_library_t*, const char*, bool);
+void phx_library_set_dbu(phx_library_t*, double);
+double phx_library_get_dbu(phx_library_t*);
+int32_t phx_library_to_dbu(phx_library_t*, double);
+double phx_library_from_dbu(phx_library_t*, int32_t);
+vec2i_t phx_library_vec_to_dbu(phx_library_t*, vec2_t);
+vec2_t phx_library_vec_from_dbu(phx_library_t*, vec2i_t);
+void phx_library_intern_shapes(phx_library_t*);
+int phx_library_save(phx_library_t*, const char*);
+int phx_library_load(phx_library_t*, const char*);
+void phx_library_memory_report(phx_library_t*, phx_memory_report_t*);
+void phx_library_update(phx_library_t*, uint8_t);
+void phx_library_set_num_threads(phx_library_t*, unsigned);
+unsigned phx_library_get_num_threads(phx_library_t*);
+void phx_library_begin_edit(phx_library_t*);
+void phx_library_commit_edit(phx_library_t*);
+void phx_library_start_trace(phx_library_t*);
+void phx_library_stop_trace(phx_library_t*);
+phx_trace_t *phx_library_get_trace(phx_library_t*);
+const char *phx_update_kind_name(phx_update_kind_t);
+void phx_memory_report_dispose(phx_memory_report_t*);
 
 /* Cell */
 phx_cell_t *new_cell(phx_library_t*, const char *name);
@@ -185,6 +537,7 @@ size_t phx_cell_get_num_insts(phx_cell_t*);
 phx_inst_t *phx_cell_get_inst(phx_cell_t*, size_t idx);
 phx_inst_t *phx_cell_find_inst(phx_cell_t*, const char*);
 phx_geometry_t *phx_cell_get_geometry(phx_cell_t*);
+void phx_cell_get_flat_layers(phx_cell_t*, phx_tech_layer_t*, array_t*);
 phx_pin_t *cell_find_pin(phx_cell_t*, const char *name);
 void phx_cell_set_gds(phx_cell_t *cell, gds_struct_t *gds);
 gds_struct_t *phx_cell_get_gds(phx_cell_t *cell);
@@ -194,6 +547,10 @@ void phx_cell_set_timing_table(phx_cell_t*, phx_pin_t*, phx_pin_t*, phx_timing_t
 void phx_cell_update(phx_cell_t*, uint8_t);
 double phx_cell_get_leakage_power(phx_cell_t*);
 void phx_cell_add_gds_text(phx_cell_t*, unsigned, unsigned, vec2_t, const char*);
+unsigned phx_cell_extract_connectivity(phx_cell_t*, array_t*);
+void phx_cell_query_region(phx_cell_t*, phx_tech_layer_t*, phx_rect_t, unsigned, void (*)(void*, phx_layer_t*, phx_layer_item_t, size_t, phx_xform_t*), void*);
+void phx_cell_query_insts(phx_cell_t*, phx_rect_t, void (*)(void*, uint32_t), void*);
+unsigned phx_cell_check_spacing(phx_cell_t*, array_t*, size_t*);
 
 /* Pin */
 const char *phx_pin_get_name(phx_pin_t*);
@@ -205,21 +562,61 @@ double phx_pin_get_capacitance(phx_pin_t*);
 void phx_geometry_init(phx_geometry_t*, phx_cell_t*);
 void phx_geometry_dispose(phx_geometry_t*);
 phx_layer_t *phx_geometry_on_layer(phx_geometry_t*, phx_tech_layer_t*);
+phx_layer_t *phx_geometry_find_layer(phx_geometry_t*, phx_tech_layer_t*);
 unsigned phx_geometry_get_num_layers(phx_geometry_t*);
 phx_layer_t *phx_geometry_get_layer(phx_geometry_t*, unsigned);
 void phx_geometry_update(phx_geometry_t*, uint8_t);
+void phx_geometry_merge(phx_geometry_t*);
+void phx_geometry_add_shared(phx_geometry_t*, phx_geometry_t*, phx_xform_t*);
+void phx_geometry_materialize(phx_geometry_t*);
+unsigned phx_geometry_get_num_refs(phx_geometry_t*);
+phx_geometry_ref_t *phx_geometry_get_ref(phx_geometry_t*, unsigned);
 
 /* Layer */
 void phx_layer_init(phx_layer_t*, phx_geometry_t*, phx_tech_layer_t*);
 void phx_layer_dispose(phx_layer_t*);
 phx_line_t *phx_layer_add_line(phx_layer_t*, double, size_t, vec2_t*);
-phx_shape_t *phx_layer_add_shape(phx_layer_t*, size_t, vec2_t*);
+void phx_layer_add_shape(phx_layer_t*, size_t, vec2_t*);
+void phx_layer_add_rect(phx_layer_t*, vec2_t, vec2_t);
+phx_line_t *phx_layer_add_line_dbu(phx_layer_t*, int32_t, size_t, vec2i_t*);
+void phx_layer_add_shape_dbu(phx_layer_t*, size_t, vec2i_t*);
+void phx_layer_add_rect_dbu(phx_layer_t*, phx_rect_t);
+void phx_layer_add_rects_dbu(phx_layer_t*, phx_rects_t*);
 size_t phx_layer_get_num_lines(phx_layer_t*);
 size_t phx_layer_get_num_shapes(phx_layer_t*);
+size_t phx_layer_get_num_rects(phx_layer_t*);
 phx_line_t *phx_layer_get_line(phx_layer_t*, size_t);
 phx_shape_t *phx_layer_get_shape(phx_layer_t*, size_t);
+vec2i_t phx_layer_get_shape_offset(phx_layer_t*, size_t);
+phx_rect_t phx_layer_get_rect(phx_layer_t*, size_t);
+phx_rect_t phx_layer_get_bounds(phx_layer_t*, phx_layer_item_t, size_t);
 void phx_layer_update(phx_layer_t*, uint8_t);
 phx_tech_layer_t *phx_layer_get_tech(phx_layer_t*);
+phx_library_t *phx_layer_get_library(phx_layer_t*);
+void phx_layer_add_transformed(phx_layer_t*, phx_layer_t*, phx_xform_t*);
+void phx_layer_merge(phx_layer_t*);
+bool phx_layer_equal(phx_layer_t*, phx_layer_t*);
+void phx_layer_query(phx_layer_t*, phx_rect_t, void (*)(void*, phx_layer_t*, phx_layer_item_t, size_t), void*);
+
+/* Rectangles */
+bool phx_rect_from_points(size_t, vec2i_t*, phx_rect_t*);
+bool phx_rect_overlaps(phx_rect_t, phx_rect_t);
+void phx_rects_init(phx_rects_t*);
+void phx_rects_dispose(phx_rects_t*);
+void phx_rects_reserve(phx_rects_t*, unsigned);
+void phx_rects_add(phx_rects_t*, phx_rect_t);
+phx_rect_t phx_rects_get(phx_rects_t*, unsigned);
+void phx_rects_clear(phx_rects_t*);
+bool phx_rects_get_bounds(phx_rects_t*, phx_rect_t*);
+unsigned phx_rects_find_overlaps(phx_rects_t*, phx_rect_t, uint32_t*);
+void phx_rects_merge(phx_rects_t*, phx_rects_t*);
+void phx_rects_subtract(phx_rects_t*, phx_rects_t*, phx_rects_t*);
+
+/* Spatial Index */
+void phx_index_init(phx_index_t*);
+void phx_index_dispose(phx_index_t*);
+void phx_index_build(phx_index_t*, unsigned, phx_rect_t*, uint32_t*);
+void phx_index_query(phx_index_t*, phx_rect_t, void (*)(void*, uint32_t), void*);
 
 /* Instance */
 phx_inst_t *new_inst(phx_cell_t *into, phx_cell_t *cell, const char *name);
@@ -234,6 +631,18 @@ vec2_t phx_inst_vec_from_parent(phx_inst_t*, vec2_t);
 vec2_t phx_inst_vec_to_parent(phx_inst_t*, vec2_t);
 void phx_inst_copy_geometry_to_parent(phx_inst_t*, phx_geometry_t*, phx_geometry_t*);
 void phx_inst_update(phx_inst_t*, uint8_t);
+phx_xform_t phx_inst_get_xform(phx_inst_t*);
+
+/* Transformation */
+phx_xform_t phx_xform_identity(void);
+phx_xform_t phx_xform_from_orientation(phx_orientation_t, vec2i_t);
+phx_xform_t phx_xform_mul(phx_xform_t, phx_xform_t);
+phx_xform_t phx_xform_invert(phx_xform_t);
+vec2i_t phx_xform_apply(phx_xform_t*, vec2i_t);
+phx_rect_t phx_xform_apply_rect(phx_xform_t*, phx_rect_t);
+vec2_t phx_xform_apply_vec(phx_xform_t*, vec2_t, double);
+void phx_xform_apply_many(phx_xform_t*, size_t, const vec2i_t*, vec2i_t*);
+void phx_xform_apply_rects(phx_xform_t*, phx_rects_t*, phx_rects_t*);
 
 
 /**
@@ -245,8 +654,8 @@ struct phx_net {
 	uint8_t invalid;
 	/// The cell this net belongs to.
 	phx_cell_t *cell;
-	/// The net's name.
-	char *name;
+	/// The net's name, interned. See intern_str.
+	const char *name;
 	/// The connections this net makes.
 	array_t conns; /* phx_terminal_t */
 	/// The capacitance of this net, including attached pins.
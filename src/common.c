@@ -5,6 +5,8 @@
 static const char *error_strings[] = {
 	[PHALANX_OK] = "OK",
 	[PHALANX_ERR_LEF_SYNTAX] = "LEF Syntax Error",
+	[PHALANX_ERR_SNAPSHOT] = "Invalid Snapshot",
+	[PHALANX_ERR_LIBRARY_NOT_EMPTY] = "Library Not Empty",
 };
 
 
@@ -16,20 +16,33 @@
 #define M_PI 3.14159265358979323846
 #endif
 
+typedef enum phx_layer_item phx_layer_item_t;
 typedef enum phx_orientation phx_orientation_t;
 typedef enum phx_table_quantity phx_table_quantity_t;
 typedef enum phx_timing_type phx_timing_type_t;
+typedef enum phx_update_kind phx_update_kind_t;
 typedef struct mat3 mat3_t;
 typedef struct phx_cell phx_cell_t;
 typedef struct phx_extents phx_extents_t;
+typedef struct phx_flat_layer phx_flat_layer_t;
+typedef struct phx_extracted_terminal phx_extracted_terminal_t;
+typedef struct phx_spacing_violation phx_spacing_violation_t;
 typedef struct phx_geometry phx_geometry_t;
+typedef struct phx_geometry_block phx_geometry_block_t;
+typedef struct phx_geometry_ref phx_geometry_ref_t;
+typedef struct phx_shape_ref phx_shape_ref_t;
+typedef struct phx_shape_table phx_shape_table_t;
+typedef struct phx_index phx_index_t;
 typedef struct phx_inst phx_inst_t;
 typedef struct phx_layer phx_layer_t;
 typedef struct phx_library phx_library_t;
+typedef struct phx_memory_report phx_memory_report_t;
 typedef struct phx_line phx_line_t;
 typedef struct phx_net phx_net_t;
 typedef struct phx_pin phx_pin_t;
 typedef struct phx_pin_timing phx_pin_timing_t;
+typedef struct phx_rect phx_rect_t;
+typedef struct phx_rects phx_rects_t;
 typedef struct phx_shape phx_shape_t;
 typedef struct phx_table phx_table_t;
 typedef struct phx_table_axis phx_table_axis_t;
@@ -37,17 +50,28 @@ typedef struct phx_table_format phx_table_format_t;
 typedef struct phx_table_lerp phx_table_lerp_t;
 typedef struct phx_table_fix phx_table_fix_t;
 typedef struct phx_tech phx_tech_t;
+typedef struct phx_tech_filter phx_tech_filter_t;
 typedef struct phx_tech_layer phx_tech_layer_t;
+typedef struct phx_tech_via phx_tech_via_t;
 typedef struct phx_terminal phx_terminal_t;
 typedef struct phx_timing_arc phx_timing_arc_t;
+typedef struct phx_trace phx_trace_t;
+typedef struct phx_trace_cell phx_trace_cell_t;
+typedef struct phx_trace_event phx_trace_event_t;
+typedef struct phx_update_counter phx_update_counter_t;
+typedef struct phx_update_pool phx_update_pool_t;
+typedef struct phx_xform phx_xform_t;
 typedef struct phx_gds_text phx_gds_text_t;
 typedef struct vec2 vec2_t;
+typedef struct vec2i vec2i_t;
 typedef union phx_table_index phx_table_index_t;
 
 
 enum {
 	PHALANX_OK = 0,
 	PHALANX_ERR_LEF_SYNTAX,
+	PHALANX_ERR_SNAPSHOT,
+	PHALANX_ERR_LIBRARY_NOT_EMPTY,
 };
 
 struct vec2 {
@@ -55,11 +79,20 @@ struct vec2 {
 	double y;
 };
 
+/**
+ * An integer point, usually in database units.
+ */
+struct vec2i {
+	int32_t x;
+	int32_t y;
+};
+
 struct mat3 {
 	double v[3][3];
 };
 
 #define VEC2(x,y) ((vec2_t){(x),(y)})
+#define VEC2I(x,y) ((vec2i_t){(x),(y)})
 
 vec2_t vec2_add(vec2_t a, vec2_t b);
 vec2_t vec2_sub(vec2_t a, vec2_t b);
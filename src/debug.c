@@ -43,7 +43,7 @@ main(int argc, char **argv) {
 				printf("Unable to read LEF file %s: %s\n", arg, errstr(res));
 				return 1;
 			}
-			load_lef(lib, in, tech);
+			load_lef(lib, in, tech, NULL);
 			printf("Loaded %u cells from %s\n", (unsigned)lef_get_num_macros(in), arg);
 			lef_free(in);
 		}
@@ -76,7 +76,7 @@ main(int argc, char **argv) {
 				return 1;
 			}
 			gds_reader_close(rd);
-			load_gds(lib, in, tech);
+			load_gds(lib, in, tech, NULL);
 			printf("Loaded %u cells from %s\n", (unsigned)gds_lib_get_num_structs(in), arg);
 			gds_lib_destroy(in);
 		}
@@ -1,5 +1,7 @@
 /* Copyright (c) 2016 Fabian Schuiki */
+#define _POSIX_C_SOURCE 200112L
 #include "design-internal.h"
+#include <pthread.h>
 
 /**
  * @file
@@ -9,14 +11,142 @@
  */
 
 
+/**
+ * Flag bits of a single cell as invalid and put the cell on the library's list
+ * of dirty cells.
+ *
+ * @return `true` if any of the bits were valid before, `false` otherwise.
+ */
+static bool
+mark_invalid(phx_cell_t *cell, uint8_t bits) {
+	if (bits & PHX_EXTENTS)
+		cell->invalid |= PHX_INDEX;
+	if (!(~cell->invalid & bits))
+		return false;
+	cell->invalid |= bits;
+	if (!cell->dirty) {
+		assert(!cell->lib->parallel && "cell invalidated by a parallel update");
+		cell->dirty = true;
+		array_add(&cell->lib->dirty, &cell);
+	}
+	return true;
+}
+
+
+/**
+ * Flag bits of the instances of a cell as invalid, together with all cells
+ * further up the hierarchy. The walk stops at cells whose bits are already
+ * invalid, since their ancestors are invalid as well.
+ */
+static void
+invalidate_uses(phx_cell_t *cell, uint8_t bits) {
+	if (cell->uses.size == 0)
+		return;
+	array_t stack;
+	array_init(&stack, sizeof(phx_cell_t*));
+	for (;;) {
+		for (unsigned u = 0; u < cell->uses.size; ++u) {
+			phx_inst_t *inst = cell->uses.items[u];
+			inst->invalid |= bits;
+			if (mark_invalid(inst->parent, bits))
+				array_add(&stack, &inst->parent);
+		}
+		if (stack.size == 0)
+			break;
+		cell = array_at(stack, phx_cell_t*, --stack.size);
+	}
+	array_dispose(&stack);
+}
+
+
+/**
+ * Remember that bits of a cell changed during an edit, such that the cells
+ * further up the hierarchy are invalidated once the edit is committed.
+ */
+static void
+record_edit(phx_cell_t *cell, uint8_t bits) {
+	if (!bits)
+		return;
+	assert(!cell->lib->parallel && "cell edited by a parallel update");
+	if (!cell->edit_bits)
+		array_add(&cell->lib->edited, &cell);
+	cell->edit_bits |= bits;
+}
+
+
+/**
+ * Flag bits of a cell as invalid, together with the instances of the cell and
+ * all cells further up the hierarchy. During an edit, only the cell itself is
+ * flagged and the rest is deferred until the edit is committed. Bits that are
+ * invalid already are not recorded, since the cells above have been taken
+ * care of when they became invalid.
+ */
 void
 phx_cell_invalidate(phx_cell_t *cell, uint8_t bits) {
 	assert(cell);
-	if (~cell->invalid & bits) {
-		cell->invalid |= bits;
-		for (unsigned u = 0; u < cell->uses.size; ++u) {
-			phx_inst_invalidate(cell->uses.items[u], bits);
-		}
+	bits &= ~PHX_INDEX;
+	if (cell->lib->edit_depth > 0) {
+		if (mark_invalid(cell, bits))
+			record_edit(cell, bits);
+		return;
+	}
+	if (mark_invalid(cell, bits))
+		invalidate_uses(cell, bits);
+}
+
+
+/**
+ * Start an edit of a library. Until the edit is committed, changes to a cell
+ * only invalidate the cell itself, and the cells instantiating it are not
+ * updated. Edits may be nested, in which case only committing the outermost
+ * edit has an effect.
+ */
+void
+phx_library_begin_edit(phx_library_t *lib) {
+	assert(lib);
+	++lib->edit_depth;
+}
+
+
+/**
+ * Commit an edit of a library. All cells above the cells changed during the
+ * edit are invalidated, with every cell visited once per invalid bit.
+ */
+void
+phx_library_commit_edit(phx_library_t *lib) {
+	assert(lib && lib->edit_depth > 0);
+	if (--lib->edit_depth > 0)
+		return;
+	for (unsigned u = 0; u < lib->edited.size; ++u) {
+		phx_cell_t *cell = array_at(lib->edited, phx_cell_t*, u);
+		uint8_t bits = cell->edit_bits;
+		cell->edit_bits = 0;
+		invalidate_uses(cell, bits);
+	}
+	lib->edited.size = 0;
+}
+
+
+/**
+ * Grow the extents of a cell to include a box, given in the cell's coordinate
+ * space. If the cell's extents are valid and change, the box is passed on to
+ * the instances of the cell. Invalid extents are left alone, since they are
+ * recalculated anyway and their ancestors are invalid as well. During an edit,
+ * the extents of the instances are invalidated upon commit instead.
+ */
+void
+phx_cell_include_extents(phx_cell_t *cell, phx_extents_t *box) {
+	assert(cell && box);
+	if (cell->invalid & PHX_EXTENTS)
+		return;
+	if (!phx_extents_include(&cell->ext, box))
+		return;
+	if (cell->lib->edit_depth > 0) {
+		record_edit(cell, PHX_EXTENTS);
+		return;
+	}
+	for (unsigned u = 0; u < cell->uses.size; ++u) {
+		phx_inst_include_extents(cell->uses.items[u], box);
 	}
 }
 
@@ -88,8 +218,7 @@ phx_cell_update_capacitances(phx_cell_t *cell) {
 	cell->invalid &= ~PHX_CAPACITANCES;
 
 	for (unsigned u = 0; u < cell->insts.size; ++u) {
-		phx_inst_t *inst = array_at(cell->insts, phx_inst_t*, u);
-		phx_cell_update(inst->cell, PHX_CAPACITANCES);
+		array_at(cell->insts, phx_inst_t*, u)->invalid &= ~PHX_CAPACITANCES;
 	}
 
 	for (unsigned u = 0; u < cell->nets.size; ++u) {
@@ -116,8 +245,7 @@ phx_cell_update_timing(phx_cell_t *cell) {
 	cell->invalid &= ~PHX_TIMING;
 
 	for (unsigned u = 0; u < cell->insts.size; ++u) {
-		phx_inst_t *inst = array_at(cell->insts, phx_inst_t*, u);
-		phx_cell_update(inst->cell, PHX_TIMING);
+		array_at(cell->insts, phx_inst_t*, u)->invalid &= ~PHX_TIMING;
 	}
 
 	for (unsigned u = 0; u < cell->nets.size; ++u) {
@@ -138,24 +266,536 @@ phx_cell_update_leakage_power(phx_cell_t *cell) {
 	double pwr = 0;
 	for (unsigned u = 0; u < cell->insts.size; ++u) {
 		phx_inst_t *inst = array_at(cell->insts, phx_inst_t*, u);
-		phx_cell_update(inst->cell, PHX_POWER_LKG);
+		inst->invalid &= ~PHX_POWER_LKG;
 		pwr += inst->cell->leakage_power;
 	}
 	cell->leakage_power = pwr;
 }
 
 
+/**
+ * Add the layers of a geometry to a list of flattened layers, placed by
+ * @a xf. Only the layer on @a tech is added, or all layers if @a tech is
+ * `NULL`. Empty layers are skipped.
+ */
+static void
+add_flat_layers(phx_geometry_t *geo, phx_tech_layer_t *tech, phx_xform_t *xf, array_t *out) {
+	for (unsigned u = 0; u < geo->layers.size; ++u) {
+		phx_layer_t *layer = array_get(&geo->layers, u);
+		if (tech && layer->tech != tech)
+			continue;
+		if (layer->rects.size + layer->shapes.size + layer->lines.size == 0)
+			continue;
+		phx_flat_layer_t flat = { layer, *xf };
+		array_add(out, &flat);
+	}
+}
+
+
+/**
+ * Add the layers of a geometry of a cell to a list of flattened layers.
+ * Shared blocks are only followed if they were created from geometry of the
+ * cell itself. Blocks raised from the cell's instances, see
+ * phx_inst_copy_geometry_to_parent, are part of the instances' flattened
+ * geometry already.
+ */
+static void
+add_own_layers(phx_cell_t *cell, phx_geometry_t *geo, phx_tech_layer_t *tech, array_t *out) {
+	phx_xform_t identity = phx_xform_identity();
+	add_flat_layers(geo, tech, &identity, out);
+	for (unsigned u = 0; u < geo->refs.size; ++u) {
+		phx_geometry_ref_t *ref = array_get(&geo->refs, u);
+		if (ref->block->geo.cell == cell)
+			add_flat_layers(&ref->block->geo, tech, &ref->xf, out);
+	}
+}
+
+
+/**
+ * Add the layers of a cell's flattened geometry to a list, without updating
+ * it. Cells without instances contribute their own layers and those of their
+ * pins in place.
+ */
+static void
+collect_flat_layers(phx_cell_t *cell, phx_tech_layer_t *tech, array_t *out) {
+	if (cell->flat) {
+		phx_xform_t identity = phx_xform_identity();
+		add_flat_layers(cell->flat, tech, &identity, out);
+		return;
+	}
+	add_own_layers(cell, &cell->geo, tech, out);
+	for (unsigned u = 0; u < cell->pins.size; ++u)
+		add_own_layers(cell, &array_at(cell->pins, phx_pin_t*, u)->geo, tech, out);
+}
+
+
+/**
+ * Bring the extents of the layers of a cell's flattened geometry up to date.
+ * Flattening the cells above reads them, possibly on several threads at once,
+ * which must not update them lazily.
+ */
+static void
+update_flat_extents(phx_cell_t *cell) {
+	array_t layers;
+	array_init(&layers, sizeof(phx_flat_layer_t));
+	collect_flat_layers(cell, NULL, &layers);
+	for (unsigned u = 0; u < layers.size; ++u)
+		phx_layer_update(array_at(layers, phx_flat_layer_t, u).layer, PHX_EXTENTS);
+	array_dispose(&layers);
+}
+
+
+/**
+ * Rebuild the flattened geometry of a cell. The geometry of the cell and of
+ * its pins is copied verbatim, and the flattened geometry of each
+ * instantiated cell is merged in with one batched transformation per instance
+ * and layer. Since the child cells cache their flattened geometry as well,
+ * each cell in the hierarchy is only flattened once, regardless of how often
+ * it is instantiated. Cells without instances, the most common kind, are not
+ * copied at all.
+ */
+static void
+phx_cell_update_flat(phx_cell_t *cell) {
+	assert(cell);
+
+	if (cell->insts.size == 0) {
+		if (cell->flat) {
+			phx_geometry_dispose(cell->flat);
+			free(cell->flat);
+			cell->flat = NULL;
+		}
+		update_flat_extents(cell);
+		cell->invalid &= ~PHX_FLAT;
+		return;
+	}
+
+	if (cell->flat)
+		phx_geometry_dispose(cell->flat);
+	else
+		cell->flat = malloc(sizeof(phx_geometry_t));
+	phx_geometry_init(cell->flat, cell);
+
+	array_t layers;
+	array_init(&layers, sizeof(phx_flat_layer_t));
+	add_own_layers(cell, &cell->geo, NULL, &layers);
+	for (unsigned u = 0; u < cell->pins.size; ++u)
+		add_own_layers(cell, &array_at(cell->pins, phx_pin_t*, u)->geo, NULL, &layers);
+	for (unsigned u = 0; u < layers.size; ++u) {
+		phx_flat_layer_t *src = array_get(&layers, u);
+		phx_layer_add_transformed(phx_geometry_on_layer(cell->flat, src->layer->tech), src->layer, &src->xf);
+	}
+
+	for (unsigned u = 0; u < cell->insts.size; ++u) {
+		phx_inst_t *inst = array_at(cell->insts, phx_inst_t*, u);
+		inst->invalid &= ~PHX_FLAT;
+		layers.size = 0;
+		phx_cell_get_flat_layers(inst->cell, NULL, &layers);
+		for (unsigned v = 0; v < layers.size; ++v) {
+			phx_flat_layer_t *src = array_get(&layers, v);
+			phx_xform_t xf = phx_xform_mul(inst->xform, src->xf);
+			phx_layer_add_transformed(phx_geometry_on_layer(cell->flat, src->layer->tech), src->layer, &xf);
+		}
+	}
+	array_dispose(&layers);
+
+	update_flat_extents(cell);
+	cell->invalid &= ~PHX_FLAT;
+}
+
+
+/**
+ * Get the layers of a cell's geometry with the geometry of its pins and of
+ * all its instances merged in, each with the transformation that places it
+ * into the cell's coordinate space. Cells with instances cache a flattened
+ * copy, which is only recalculated after the cell or one of its instantiated
+ * cells changed. Cells without instances report their own layers and those of
+ * their pins in place. The layers are owned by the cell and must not be
+ * modified.
+ *
+ * @param tech  The technology layer to report, or `NULL` to report all.
+ * @param out   Array of phx_flat_layer_t the layers are added to.
+ */
+void
+phx_cell_get_flat_layers(phx_cell_t *cell, phx_tech_layer_t *tech, array_t *out) {
+	assert(cell && out && out->item_size == sizeof(phx_flat_layer_t));
+	phx_cell_update(cell, PHX_FLAT);
+	collect_flat_layers(cell, tech, out);
+}
+
+
+/**
+ * The updates of a cell, in the order they are performed.
+ */
+static const struct {
+	uint8_t bit;
+	phx_update_kind_t kind;
+	void (*update)(phx_cell_t*);
+} cell_updates[] = {
+	{PHX_EXTENTS,      PHX_UPDATE_EXTENTS,      phx_cell_update_extents},
+	{PHX_CAPACITANCES, PHX_UPDATE_CAPACITANCES, phx_cell_update_capacitances},
+	{PHX_TIMING,       PHX_UPDATE_TIMING,       phx_cell_update_timing},
+	{PHX_POWER_LKG,    PHX_UPDATE_LEAKAGE,      phx_cell_update_leakage_power},
+	{PHX_FLAT,         PHX_UPDATE_FLAT,         phx_cell_update_flat},
+};
+
+
+/**
+ * Record requests for bits of a cell that are valid already in the library's
+ * trace.
+ */
+static void
+trace_hits(phx_cell_t *cell, uint8_t bits) {
+	for (unsigned u = 0; u < ASIZE(cell_updates); ++u)
+		if (bits & ~cell->invalid & cell_updates[u].bit)
+			phx_trace_hit(cell->lib, cell_updates[u].kind, cell);
+}
+
+
+/**
+ * Recalculate invalid bits of a single cell. The cells it instantiates must be
+ * up to date already.
+ */
+static void
+update_cell(phx_cell_t *cell, uint8_t bits) {
+	assert(cell);
+	phx_library_t *lib = cell->lib;
+	if (lib->trace)
+		trace_hits(cell, bits);
+	for (unsigned u = 0; u < ASIZE(cell_updates); ++u) {
+		if (!(cell->invalid & bits & cell_updates[u].bit))
+			continue;
+		if (lib->trace) {
+			uint64_t start = phx_trace_now();
+			cell_updates[u].update(cell);
+			phx_trace_update(lib, cell_updates[u].kind, cell, start);
+		} else {
+			cell_updates[u].update(cell);
+		}
+	}
+	// Internal power is not calculated yet, so there is nothing to update.
+	cell->invalid &= ~(bits & PHX_POWER_INT);
+}
+
+
+/**
+ * The bits of a cell that only depend on the cell itself and the cells it
+ * instantiates, and may thus be updated concurrently for all cells on one level
+ * of the hierarchy. Timing updates modify tables shared across cells and are
+ * therefore performed by one thread only. Updating these bits must not
+ * invalidate any cell, since that changes the library's lists of dirty and
+ * edited cells. In particular, building the flattened geometry only changes
+ * the cell's flattened copy, which does not invalidate the cell.
+ */
+#define PHX_PARALLEL_BITS (PHX_EXTENTS | PHX_CAPACITANCES | PHX_POWER_LKG | PHX_POWER_INT | PHX_FLAT)
+
+/**
+ * A bottom-up update of a list of cells, sorted by level.
+ */
+typedef struct {
+	phx_cell_t **cells;
+	/// The position in @a cells one past the last cell of each level.
+	unsigned *level_end;
+	unsigned num_levels;
+	/// The position of the next cell to be updated on each level. Advanced
+	/// atomically by the threads taking part in the update.
+	unsigned *level_next;
+	/// The bits updated concurrently, and those updated by the calling
+	/// thread once a level is complete.
+	uint8_t parallel_bits;
+	uint8_t serial_bits;
+} update_job_t;
+
+/**
+ * The threads of a library that help the calling thread update the cells on
+ * one level of an update job. The threads wait for the next level to be
+ * posted, and meet the calling thread at the barrier once the level is done.
+ */
+struct phx_update_pool {
+	pthread_t *threads;
+	unsigned num_threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t posted;
+	/// Incremented for every level posted.
+	unsigned generation;
+	/// The job and level posted last.
+	update_job_t *job;
+	unsigned level;
+	/// Set to have the threads exit.
+	bool stop;
+	pthread_barrier_t barrier;
+};
+
+
+/**
+ * Take cells off a level of an update job until none are left.
+ */
+static void
+update_level(update_job_t *job, unsigned level) {
+	for (;;) {
+		unsigned u = __sync_fetch_and_add(&job->level_next[level], 1);
+		if (u >= job->level_end[level])
+			break;
+		update_cell(job->cells[u], job->parallel_bits);
+	}
+}
+
+
+static void *
+update_worker(void *arg) {
+	phx_update_pool_t *pool = arg;
+	unsigned seen = 0;
+	for (;;) {
+		pthread_mutex_lock(&pool->mutex);
+		while (pool->generation == seen && !pool->stop)
+			pthread_cond_wait(&pool->posted, &pool->mutex);
+		if (pool->stop) {
+			pthread_mutex_unlock(&pool->mutex);
+			return NULL;
+		}
+		seen = pool->generation;
+		update_job_t *job = pool->job;
+		unsigned level = pool->level;
+		pthread_mutex_unlock(&pool->mutex);
+
+		update_level(job, level);
+		pthread_barrier_wait(&pool->barrier);
+	}
+}
+
+
+static phx_update_pool_t *
+start_pool(unsigned num_threads) {
+	phx_update_pool_t *pool = calloc(1, sizeof(*pool));
+	pool->num_threads = num_threads;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->posted, NULL);
+	pthread_barrier_init(&pool->barrier, NULL, num_threads + 1);
+	pool->threads = malloc(num_threads * sizeof(pthread_t));
+	for (unsigned u = 0; u < num_threads; ++u) {
+		int err = pthread_create(&pool->threads[u], NULL, update_worker, pool);
+		assert(err == 0 && "cannot create update thread");
+		(void)err;
+	}
+	return pool;
+}
+
+
+/**
+ * Stop the threads a library updates its cells with. They are started again
+ * by the next update that needs them.
+ */
+void
+phx_library_stop_pool(phx_library_t *lib) {
+	assert(lib);
+	phx_update_pool_t *pool = lib->pool;
+	if (!pool)
+		return;
+	lib->pool = NULL;
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->posted);
+	pthread_mutex_unlock(&pool->mutex);
+	for (unsigned u = 0; u < pool->num_threads; ++u)
+		pthread_join(pool->threads[u], NULL);
+	pthread_barrier_destroy(&pool->barrier);
+	pthread_cond_destroy(&pool->posted);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+
+/**
+ * Update the cells on one level of a job with the help of the pool's threads,
+ * and wait for all of them to be done.
+ */
+static void
+run_level(phx_library_t *lib, update_job_t *job, unsigned level) {
+	phx_update_pool_t *pool = lib->pool;
+	lib->parallel = true;
+	pthread_mutex_lock(&pool->mutex);
+	pool->job = job;
+	pool->level = level;
+	++pool->generation;
+	pthread_cond_broadcast(&pool->posted);
+	pthread_mutex_unlock(&pool->mutex);
+	update_level(job, level);
+	pthread_barrier_wait(&pool->barrier);
+	lib->parallel = false;
+}
+
+
+/**
+ * Update the extents of the shared geometry blocks placed in a geometry, such
+ * that they are not updated lazily by several threads at once.
+ */
+static void
+update_shared_extents(phx_geometry_t *geo) {
+	for (unsigned u = 0; u < geo->refs.size; ++u) {
+		phx_geometry_ref_t *ref = array_get(&geo->refs, u);
+		phx_geometry_update(&ref->block->geo, PHX_EXTENTS);
+	}
+}
+
+
+/**
+ * Update a list of cells bottom-up. The cells are sorted by their level in the
+ * hierarchy, such that every cell is updated exactly once and after all cells
+ * it instantiates. The cells on each level are updated concurrently if the
+ * library is configured to use multiple threads.
+ */
+static void
+update_cells(phx_cell_t **cells, unsigned num_cells, uint8_t bits) {
+	if (num_cells == 0)
+		return;
+	phx_library_t *lib = cells[0]->lib;
+
+	// Sort the cells by level, counting the cells on each level first.
+	unsigned num_levels = 0;
+	for (unsigned u = 0; u < num_cells; ++u)
+		if (cells[u]->level >= num_levels)
+			num_levels = cells[u]->level + 1;
+	unsigned *level_next = calloc(num_levels + 1, sizeof(unsigned));
+	unsigned *level_end = calloc(num_levels + 1, sizeof(unsigned));
+	for (unsigned u = 0; u < num_cells; ++u)
+		++level_end[cells[u]->level + 1];
+	for (unsigned u = 0; u < num_levels; ++u) {
+		level_end[u+1] += level_end[u];
+		level_next[u] = level_end[u];
+	}
+	phx_cell_t **sorted = malloc(num_cells * sizeof(phx_cell_t*));
+	for (unsigned u = 0; u < num_cells; ++u)
+		sorted[level_end[cells[u]->level]++] = cells[u];
+
+	update_job_t job = {
+		.cells = sorted,
+		.level_end = level_end,
+		.num_levels = num_levels,
+		.level_next = level_next,
+		.parallel_bits = bits & PHX_PARALLEL_BITS,
+		.serial_bits = bits & ~PHX_PARALLEL_BITS,
+	};
+
+	// Flattening interns shapes in the library's shared table, which is not
+	// safe to do concurrently.
+	if (lib->shapes) {
+		job.parallel_bits &= ~PHX_FLAT;
+		job.serial_bits |= bits & PHX_FLAT;
+	}
+
+	// Levels with fewer cells than threads are updated by the calling
+	// thread alone, which saves waking the others.
+	unsigned num_threads = lib->num_threads;
+	bool parallel = false;
+	for (unsigned u = 0; u < num_levels && num_threads > 1; ++u)
+		if (level_end[u] - (u > 0 ? level_end[u-1] : 0) >= num_threads)
+			parallel = true;
+
+	if (parallel) {
+		if (bits & PHX_EXTENTS) {
+			for (unsigned u = 0; u < num_cells; ++u) {
+				phx_cell_t *cell = sorted[u];
+				update_shared_extents(&cell->geo);
+				for (unsigned v = 0; v < cell->pins.size; ++v)
+					update_shared_extents(&array_at(cell->pins, phx_pin_t*, v)->geo);
+			}
+		}
+		// The flattened geometry of instantiated cells that is not rebuilt
+		// during this update is read by several threads.
+		if (job.parallel_bits & PHX_FLAT) {
+			for (unsigned u = 0; u < num_cells; ++u) {
+				phx_cell_t *cell = sorted[u];
+				for (unsigned v = 0; v < cell->insts.size; ++v) {
+					phx_cell_t *child = array_at(cell->insts, phx_inst_t*, v)->cell;
+					if (!(child->invalid & PHX_FLAT))
+						update_flat_extents(child);
+				}
+			}
+		}
+		if (!lib->pool)
+			lib->pool = start_pool(num_threads - 1);
+	}
+
+	for (unsigned u = 0; u < num_levels; ++u) {
+		unsigned begin = u > 0 ? level_end[u-1] : 0;
+		if (parallel && level_end[u] - begin >= num_threads)
+			run_level(lib, &job, u);
+		else
+			update_level(&job, u);
+		if (job.serial_bits)
+			for (unsigned v = begin; v < level_end[u]; ++v)
+				update_cell(sorted[v], job.serial_bits);
+	}
+
+	free(sorted);
+	free(level_next);
+	free(level_end);
+}
+
+
+/**
+ * Recalculate invalid bits of a cell and of all cells below it in the
+ * hierarchy. Only the invalid part of the hierarchy is visited.
+ */
 void
 phx_cell_update(phx_cell_t *cell, uint8_t bits) {
 	assert(cell);
-	if (cell->invalid & bits & PHX_EXTENTS)
-		phx_cell_update_extents(cell);
-	if (cell->invalid & bits & PHX_CAPACITANCES)
-		phx_cell_update_capacitances(cell);
-	if (cell->invalid & bits & PHX_TIMING)
-		phx_cell_update_timing(cell);
-	if (cell->invalid & bits & PHX_POWER_LKG)
-		phx_cell_update_leakage_power(cell);
+	bits &= ~PHX_INDEX;
+	if (!(cell->invalid & bits)) {
+		if (cell->lib->trace)
+			trace_hits(cell, bits);
+		return;
+	}
+
+	// Gather the invalid cells below this cell. Cells whose bits are valid
+	// are skipped, since everything they instantiate is valid as well.
+	phx_library_t *lib = cell->lib;
+	unsigned mark = ++lib->visit_mark;
+	array_t cells;
+	array_init(&cells, sizeof(phx_cell_t*));
+	cell->visited = mark;
+	array_add(&cells, &cell);
+	for (unsigned u = 0; u < cells.size; ++u) {
+		phx_cell_t *parent = array_at(cells, phx_cell_t*, u);
+		for (unsigned v = 0; v < parent->insts.size; ++v) {
+			phx_cell_t *child = array_at(parent->insts, phx_inst_t*, v)->cell;
+			if ((child->invalid & bits) && child->visited != mark) {
+				child->visited = mark;
+				array_add(&cells, &child);
+			}
+		}
+	}
+
+	update_cells(cells.items, cells.size, bits);
+	array_dispose(&cells);
+}
+
+
+/**
+ * Recalculate invalid bits of all cells in a library. Only the cells on the
+ * library's list of dirty cells are visited, each of them once. Cells that
+ * remain invalid in bits not requested stay on the list.
+ */
+void
+phx_library_update(phx_library_t *lib, uint8_t bits) {
+	assert(lib);
+	bits &= ~PHX_INDEX;
+
+	// Take the list of dirty cells, such that cells invalidated during the
+	// update are collected separately.
+	array_t dirty = lib->dirty;
+	array_init(&lib->dirty, sizeof(phx_cell_t*));
+	update_cells(dirty.items, dirty.size, bits);
+
+	for (unsigned u = 0; u < dirty.size; ++u) {
+		phx_cell_t *cell = array_at(dirty, phx_cell_t*, u);
+		if (cell->invalid & ~PHX_INDEX) {
+			array_add(&lib->dirty, &cell);
+		} else {
+			cell->dirty = false;
+		}
+	}
+	array_dispose(&dirty);
 }
 
 
@@ -197,14 +837,7 @@ phx_pin_get_capacitance(phx_pin_t *pin) {
 phx_inst_t *
 phx_cell_find_inst(phx_cell_t *cell, const char *name) {
 	assert(cell && name);
-	/// @todo Use an index for this.
-	for (unsigned u = 0; u < cell->insts.size; ++u) {
-		phx_inst_t *inst = array_at(cell->insts, phx_inst_t*, u);
-		if (strcmp(inst->name, name) == 0) {
-			return inst;
-		}
-	}
-	return NULL;
+	return strmap_get(&cell->insts_by_name, name);
 }
 
 
@@ -220,3 +853,123 @@ phx_cell_add_gds_text(phx_cell_t *cell, unsigned layer, unsigned type, vec2_t po
 	memcpy(txt->text, text, len);
 	array_add(&cell->gds_text, &txt);
 }
+
+
+static void
+phx_cell_update_inst_index(phx_cell_t *cell) {
+	assert(cell);
+	cell->invalid &= ~PHX_INDEX;
+	uint64_t start = cell->lib->trace ? phx_trace_now() : 0;
+
+	unsigned num = cell->insts.size;
+	phx_rect_t *boxes = malloc(num * sizeof(phx_rect_t));
+	uint32_t *ids = malloc(num * sizeof(uint32_t));
+	for (unsigned u = 0; u < num; ++u) {
+		phx_inst_t *inst = array_at(cell->insts, phx_inst_t*, u);
+		phx_inst_update(inst, PHX_EXTENTS);
+		boxes[u].min = phx_library_vec_to_dbu(cell->lib, inst->ext.min);
+		boxes[u].max = phx_library_vec_to_dbu(cell->lib, inst->ext.max);
+		ids[u] = u;
+	}
+	phx_index_build(&cell->inst_index, num, boxes, ids);
+	free(boxes);
+	free(ids);
+	if (cell->lib->trace)
+		phx_trace_update(cell->lib, PHX_UPDATE_INST_INDEX, cell, start);
+}
+
+
+struct region_query {
+	phx_tech_layer_t *tech;
+	void (*cb)(void*, phx_layer_t*, phx_layer_item_t, size_t, phx_xform_t*);
+	void *arg;
+};
+
+struct region_query_cell {
+	struct region_query *q;
+	phx_cell_t *cell;
+	phx_xform_t xf;
+	phx_rect_t box;
+	unsigned depth;
+};
+
+static void region_query_cell(struct region_query_cell*);
+
+
+static void
+region_query_layer_hit(void *arg, phx_layer_t *layer, phx_layer_item_t kind, size_t idx) {
+	struct region_query_cell *qc = arg;
+	qc->q->cb(qc->q->arg, layer, kind, idx, &qc->xf);
+}
+
+
+static void
+region_query_inst_hit(void *arg, uint32_t idx) {
+	struct region_query_cell *qc = arg;
+	phx_inst_t *inst = array_at(qc->cell->insts, phx_inst_t*, idx);
+	phx_xform_t xf = phx_inst_get_xform(inst);
+	phx_xform_t inv = phx_xform_invert(xf);
+	struct region_query_cell sub = {
+		.q = qc->q,
+		.cell = inst->cell,
+		.xf = phx_xform_mul(qc->xf, xf),
+		.box = phx_xform_apply_rect(&inv, qc->box),
+		.depth = qc->depth - 1,
+	};
+	region_query_cell(&sub);
+}
+
+
+static void
+region_query_cell(struct region_query_cell *qc) {
+	phx_layer_t *layer = phx_geometry_find_layer(&qc->cell->geo, qc->q->tech);
+	if (layer)
+		phx_layer_query(layer, qc->box, region_query_layer_hit, qc);
+	if (qc->depth > 0 && qc->cell->insts.size > 0) {
+		if (qc->cell->invalid & PHX_INDEX)
+			phx_cell_update_inst_index(qc->cell);
+		phx_index_query(&qc->cell->inst_index, qc->box, region_query_inst_hit, qc);
+	}
+}
+
+
+/**
+ * Find the geometry on a layer that overlaps or touches a region of a cell,
+ * including the geometry of the cell's instances down to a given depth. The
+ * hierarchy is not flattened. Instead, the region is transformed into each
+ * instance's coordinate space, and only instances whose extents overlap the
+ * region are descended into.
+ *
+ * The callback is called with @a arg, the layer the geometry was found on, the
+ * kind and index of the geometry within that layer, and the transformation
+ * that maps the layer's coordinates to the coordinates of @a cell.
+ *
+ * @param tech   The technology layer to search.
+ * @param box    The region to search, in database units.
+ * @param depth  The number of instance levels to descend. Pass 0 to only
+ *               search the cell's own geometry, or `-1` to search the entire
+ *               hierarchy.
+ */
+void
+phx_cell_query_region(phx_cell_t *cell, phx_tech_layer_t *tech, phx_rect_t box, unsigned depth, void (*cb)(void*, phx_layer_t*, phx_layer_item_t, size_t, phx_xform_t*), void *arg) {
+	assert(cell && tech && cb);
+	phx_cell_update(cell, PHX_EXTENTS);
+	struct region_query q = { tech, cb, arg };
+	struct region_query_cell qc = { &q, cell, phx_xform_identity(), box, depth };
+	region_query_cell(&qc);
+}
+
+
+/**
+ * Find the instances of a cell whose extents overlap or touch a region, given
+ * in database units. The callback is called with @a arg and the index of each
+ * instance found, as accepted by phx_cell_get_inst.
+ */
+void
+phx_cell_query_insts(phx_cell_t *cell, phx_rect_t box, void (*cb)(void*, uint32_t), void *arg) {
+	assert(cell && cb);
+	phx_cell_update(cell, PHX_EXTENTS);
+	if (cell->invalid & PHX_INDEX)
+		phx_cell_update_inst_index(cell);
+	phx_index_query(&cell->inst_index, box, cb, arg);
+}
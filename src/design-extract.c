@@ -0,0 +1,475 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#include "design-internal.h"
+#include "tech.h"
+
+/**
+ * @file
+ *
+ * This file implements the extraction of electrical connectivity from the
+ * geometry of a cell. Every rectangle, shape, and line of the flattened cell,
+ * as well as the geometry of every pin, becomes a node in a union-find
+ * structure. Lines are split into one item per segment, such that the items
+ * are rectangles and polygons. Items on the same layer that overlap or touch
+ * join their nodes. A spatial index per layer finds the candidates by their
+ * bounding boxes; items other than rectangles are then tested with their
+ * actual outline. The technology's via rules then join the nodes on a cut
+ * layer with the nodes they overlap on the layers below and above.
+ */
+
+
+/**
+ * A piece of geometry in the extraction. Rectangles are fully described by
+ * their bounding box and have no points. Polygons refer to @a num_pts points
+ * in the layer's point array, starting at @a first.
+ */
+typedef struct extract_item {
+	uint32_t node;
+	uint32_t first;
+	uint32_t num_pts;
+} extract_item_t;
+
+
+typedef struct extract_layer {
+	phx_tech_layer_t *tech;
+	array_t boxes; /* phx_rect_t */
+	array_t items; /* extract_item_t */
+	array_t pts; /* vec2i_t */
+	phx_index_t index;
+} extract_layer_t;
+
+typedef struct extract {
+	/// The layers of geometry, indexed by the technology layer's index. The
+	/// `tech` field of unused layers is `NULL`.
+	extract_layer_t *layers;
+	unsigned num_layers;
+	/// The union-find forest. Each node points to its parent, roots point to
+	/// themselves.
+	array_t parents; /* uint32_t */
+	/// The number of nodes in each root's tree.
+	array_t sizes; /* uint32_t */
+	/// The terminals and the node that represents each.
+	array_t terms; /* phx_extracted_terminal_t */
+} extract_t;
+
+
+static extract_layer_t *
+find_layer(extract_t *ex, phx_tech_layer_t *tech, bool create) {
+	assert(tech->index < ex->num_layers);
+	extract_layer_t *layer = ex->layers + tech->index;
+	if (layer->tech || !create)
+		return layer->tech ? layer : NULL;
+	layer->tech = tech;
+	array_init(&layer->boxes, sizeof(phx_rect_t));
+	array_init(&layer->items, sizeof(extract_item_t));
+	array_init(&layer->pts, sizeof(vec2i_t));
+	phx_index_init(&layer->index);
+	return layer;
+}
+
+
+static uint32_t
+make_node(extract_t *ex) {
+	uint32_t node = ex->parents.size, size = 1;
+	array_add(&ex->parents, &node);
+	array_add(&ex->sizes, &size);
+	return node;
+}
+
+
+static uint32_t
+find_root(extract_t *ex, uint32_t node) {
+	uint32_t *parents = ex->parents.items;
+	while (parents[node] != node) {
+		parents[node] = parents[parents[node]];
+		node = parents[node];
+	}
+	return node;
+}
+
+
+static void
+join(extract_t *ex, uint32_t a, uint32_t b) {
+	uint32_t *parents = ex->parents.items, *sizes = ex->sizes.items;
+	a = find_root(ex, a);
+	b = find_root(ex, b);
+	if (a == b)
+		return;
+	if (sizes[a] < sizes[b]) {
+		uint32_t tmp = a;
+		a = b;
+		b = tmp;
+	}
+	parents[b] = a;
+	sizes[a] += sizes[b];
+}
+
+
+static void
+add_rect(extract_layer_t *layer, phx_rect_t box, uint32_t node) {
+	extract_item_t item = { node, 0, 0 };
+	array_add(&layer->boxes, &box);
+	array_add(&layer->items, &item);
+}
+
+
+/**
+ * Add a polygon to the extraction, transformed by @a xf. Its bounding box is
+ * computed from the transformed points.
+ */
+static void
+add_polygon(extract_layer_t *layer, unsigned num_pts, vec2i_t *pts, vec2i_t off, phx_xform_t *xf, uint32_t node) {
+	assert(num_pts > 0);
+	extract_item_t item = { node, layer->pts.size, num_pts };
+	phx_rect_t box;
+	for (unsigned u = 0; u < num_pts; ++u) {
+		vec2i_t p = phx_xform_apply(xf, (vec2i_t){ pts[u].x + off.x, pts[u].y + off.y });
+		array_add(&layer->pts, &p);
+		if (u == 0) {
+			box.min = p;
+			box.max = p;
+			continue;
+		}
+		if (p.x < box.min.x) box.min.x = p.x;
+		if (p.y < box.min.y) box.min.y = p.y;
+		if (p.x > box.max.x) box.max.x = p.x;
+		if (p.y > box.max.y) box.max.y = p.y;
+	}
+	array_add(&layer->boxes, &box);
+	array_add(&layer->items, &item);
+}
+
+
+/**
+ * Add a line to the extraction as one item per segment, transformed by
+ * @a xf. Each segment is widened to both sides and extended at both ends by
+ * half the line's width, matching the line's bounds. Horizontal and vertical
+ * segments become rectangles, all others become quadrilaterals.
+ */
+static void
+add_line(extract_layer_t *layer, phx_line_t *line, phx_xform_t *xf, uint32_t node) {
+	int32_t hw = (line->width + 1) / 2;
+	for (unsigned u = 0; u + 1 < line->num_pts; ++u) {
+		vec2i_t a = line->pts[u], b = line->pts[u+1];
+		if (a.x == b.x || a.y == b.y) {
+			phx_rect_t r = {
+				{ (a.x < b.x ? a.x : b.x) - hw, (a.y < b.y ? a.y : b.y) - hw },
+				{ (a.x > b.x ? a.x : b.x) + hw, (a.y > b.y ? a.y : b.y) + hw },
+			};
+			add_rect(layer, phx_xform_apply_rect(xf, r), node);
+			continue;
+		}
+		double dx = b.x - a.x, dy = b.y - a.y;
+		double len = sqrt(dx*dx + dy*dy);
+		double ux = dx / len * hw, uy = dy / len * hw;
+		vec2i_t quad[4] = {
+			{ lround(a.x - ux + uy), lround(a.y - uy - ux) },
+			{ lround(b.x + ux + uy), lround(b.y + uy - ux) },
+			{ lround(b.x + ux - uy), lround(b.y + uy + ux) },
+			{ lround(a.x - ux - uy), lround(a.y - uy + ux) },
+		};
+		add_polygon(layer, 4, quad, (vec2i_t){ 0, 0 }, xf, node);
+	}
+}
+
+
+/**
+ * Add the geometry of a layer to the extraction, transformed by @a xf. If
+ * @a node is not `NULL`, all geometry is attached to that node. Otherwise a
+ * new node is created for each rectangle, shape, and line.
+ */
+static void
+add_layer(extract_t *ex, phx_layer_t *src, phx_xform_t *xf, uint32_t *node) {
+	extract_layer_t *layer = find_layer(ex, src->tech, true);
+	for (size_t z = 0; z < src->rects.size; ++z)
+		add_rect(layer, phx_xform_apply_rect(xf, phx_layer_get_rect(src, z)), node ? *node : make_node(ex));
+	for (size_t z = 0; z < src->shapes.size; ++z) {
+		phx_shape_ref_t *ref = array_get(&src->shapes, z);
+		add_polygon(layer, ref->shape->num_pts, ref->shape->pts, ref->off, xf, node ? *node : make_node(ex));
+	}
+	for (size_t z = 0; z < src->lines.size; ++z)
+		add_line(layer, phx_layer_get_line(src, z), xf, node ? *node : make_node(ex));
+}
+
+
+/**
+ * Attach the geometry of a pin to @a node, including the shared geometry it
+ * references. The node is created upon the first layer that is not empty.
+ *
+ * @return Whether any geometry has been attached so far.
+ */
+static bool
+add_pin_geometry(extract_t *ex, phx_geometry_t *geo, phx_xform_t *xf, uint32_t node, bool any) {
+	for (unsigned u = 0; u < geo->layers.size; ++u) {
+		phx_layer_t *layer = array_get(&geo->layers, u);
+		if (layer->rects.size + layer->shapes.size + layer->lines.size == 0)
+			continue;
+		if (!any)
+			make_node(ex);
+		any = true;
+		add_layer(ex, layer, xf, &node);
+	}
+	for (unsigned u = 0; u < geo->refs.size; ++u) {
+		phx_geometry_ref_t *ref = array_get(&geo->refs, u);
+		phx_xform_t sub = phx_xform_mul(*xf, ref->xf);
+		any = add_pin_geometry(ex, &ref->block->geo, &sub, node, any);
+	}
+	return any;
+}
+
+
+/**
+ * Add the geometry of a pin to the extraction, attached to a new node. Pins
+ * without geometry are skipped.
+ */
+static void
+add_terminal(extract_t *ex, phx_inst_t *inst, phx_pin_t *pin, phx_xform_t *xf) {
+	uint32_t node = ex->parents.size;
+	if (add_pin_geometry(ex, &pin->geo, xf, node, false)) {
+		phx_extracted_terminal_t term = { { inst, pin }, node };
+		array_add(&ex->terms, &term);
+	}
+}
+
+
+/**
+ * Determine the orientation of the triangle @a a, @a b, @a c: positive if
+ * counter-clockwise, negative if clockwise, zero if the points are collinear.
+ */
+static int
+orientation(vec2i_t a, vec2i_t b, vec2i_t c) {
+	int64_t d = (int64_t)(b.x - a.x) * (c.y - a.y) - (int64_t)(b.y - a.y) * (c.x - a.x);
+	return (d > 0) - (d < 0);
+}
+
+
+static bool
+on_segment(vec2i_t a, vec2i_t b, vec2i_t p) {
+	return p.x >= (a.x < b.x ? a.x : b.x) && p.x <= (a.x > b.x ? a.x : b.x) &&
+	       p.y >= (a.y < b.y ? a.y : b.y) && p.y <= (a.y > b.y ? a.y : b.y);
+}
+
+
+/**
+ * Check whether the segments @a a0 @a a1 and @a b0 @a b1 intersect or touch.
+ */
+static bool
+segments_touch(vec2i_t a0, vec2i_t a1, vec2i_t b0, vec2i_t b1) {
+	int o1 = orientation(a0, a1, b0), o2 = orientation(a0, a1, b1);
+	int o3 = orientation(b0, b1, a0), o4 = orientation(b0, b1, a1);
+	if (o1 != o2 && o3 != o4 && o1 * o2 <= 0 && o3 * o4 <= 0)
+		return true;
+	return (o1 == 0 && on_segment(a0, a1, b0)) ||
+	       (o2 == 0 && on_segment(a0, a1, b1)) ||
+	       (o3 == 0 && on_segment(b0, b1, a0)) ||
+	       (o4 == 0 && on_segment(b0, b1, a1));
+}
+
+
+/**
+ * Check whether point @a p lies inside a polygon, using the even-odd rule.
+ * Points on the outline may be reported either way.
+ */
+static bool
+point_inside(vec2i_t p, unsigned num_pts, vec2i_t *pts) {
+	bool inside = false;
+	for (unsigned u = 0, v = num_pts-1; u < num_pts; v = u++) {
+		vec2i_t a = pts[v], b = pts[u];
+		if ((a.y > p.y) == (b.y > p.y))
+			continue;
+		int o = orientation(a, b, p);
+		if (b.y > a.y ? o > 0 : o < 0)
+			inside = !inside;
+	}
+	return inside;
+}
+
+
+/**
+ * Check whether two polygons overlap or touch. Either their outlines
+ * intersect, or one lies entirely within the other.
+ */
+static bool
+polygons_touch(unsigned na, vec2i_t *a, unsigned nb, vec2i_t *b) {
+	for (unsigned u = 0, v = na-1; u < na; v = u++)
+		for (unsigned w = 0, x = nb-1; w < nb; x = w++)
+			if (segments_touch(a[v], a[u], b[x], b[w]))
+				return true;
+	return point_inside(a[0], nb, b) || point_inside(b[0], na, a);
+}
+
+
+/**
+ * Get the outline of an item. Rectangles are written to @a buf.
+ */
+static vec2i_t *
+item_outline(extract_layer_t *layer, uint32_t idx, vec2i_t buf[4], unsigned *num_pts) {
+	extract_item_t *item = array_get(&layer->items, idx);
+	if (item->num_pts > 0) {
+		*num_pts = item->num_pts;
+		return (vec2i_t*)layer->pts.items + item->first;
+	}
+	phx_rect_t box = array_at(layer->boxes, phx_rect_t, idx);
+	buf[0] = box.min;
+	buf[1] = (vec2i_t){ box.max.x, box.min.y };
+	buf[2] = box.max;
+	buf[3] = (vec2i_t){ box.min.x, box.max.y };
+	*num_pts = 4;
+	return buf;
+}
+
+
+struct join_ctx {
+	extract_t *ex;
+	extract_layer_t *a;
+	uint32_t idx;
+	extract_layer_t *b;
+};
+
+
+static void
+join_hit(void *arg, uint32_t idx) {
+	struct join_ctx *ctx = arg;
+	extract_item_t *ia = array_get(&ctx->a->items, ctx->idx);
+	extract_item_t *ib = array_get(&ctx->b->items, idx);
+	if (ia->node == ib->node)
+		return;
+
+	// The bounding boxes of two rectangles are exact. Other items need their
+	// outlines tested.
+	if (ia->num_pts > 0 || ib->num_pts > 0) {
+		vec2i_t bufa[4], bufb[4];
+		unsigned na, nb;
+		vec2i_t *pa = item_outline(ctx->a, ctx->idx, bufa, &na);
+		vec2i_t *pb = item_outline(ctx->b, idx, bufb, &nb);
+		if (!polygons_touch(na, pa, nb, pb))
+			return;
+	}
+	join(ctx->ex, ia->node, ib->node);
+}
+
+
+/**
+ * Join each node on layer @a a with the nodes on layer @a b its geometry
+ * overlaps or touches.
+ */
+static void
+join_layers(extract_t *ex, extract_layer_t *a, extract_layer_t *b) {
+	struct join_ctx ctx = { ex, a, 0, b };
+	for (unsigned u = 0; u < a->boxes.size; ++u) {
+		ctx.idx = u;
+		phx_index_query(&b->index, array_at(a->boxes, phx_rect_t, u), join_hit, &ctx);
+	}
+}
+
+
+/**
+ * Find the groups of electrically connected geometry in a cell, and determine
+ * which group each of the cell's pins and each of its instances' pins belongs
+ * to. The geometry of all instances is taken into account. Two pieces of
+ * geometry are connected if they overlap or touch on the same layer, or if
+ * they are joined by a via declared in the technology. Pins
+ * without geometry are not reported.
+ *
+ * @param out  Array of phx_extracted_terminal_t that receives the terminals,
+ *             sorted by group. Groups are numbered consecutively from 0.
+ *
+ * @return The number of groups that contain at least one terminal.
+ */
+unsigned
+phx_cell_extract_connectivity(phx_cell_t *cell, array_t *out) {
+	assert(cell && out && out->item_size == sizeof(phx_extracted_terminal_t));
+	extract_t ex;
+	ex.num_layers = phx_tech_get_num_layer_indices(cell->lib->tech);
+	ex.layers = calloc(ex.num_layers, sizeof(extract_layer_t));
+	array_init(&ex.parents, sizeof(uint32_t));
+	array_init(&ex.sizes, sizeof(uint32_t));
+	array_init(&ex.terms, sizeof(phx_extracted_terminal_t));
+
+	// Gather the geometry and the terminals.
+	phx_xform_t identity = phx_xform_identity();
+	array_t flat;
+	array_init(&flat, sizeof(phx_flat_layer_t));
+	phx_cell_get_flat_layers(cell, NULL, &flat);
+	for (unsigned u = 0; u < flat.size; ++u) {
+		phx_flat_layer_t *layer = array_get(&flat, u);
+		add_layer(&ex, layer->layer, &layer->xf, NULL);
+	}
+	array_dispose(&flat);
+	for (unsigned u = 0; u < cell->pins.size; ++u)
+		add_terminal(&ex, NULL, array_at(cell->pins, phx_pin_t*, u), &identity);
+	for (unsigned u = 0; u < cell->insts.size; ++u) {
+		phx_inst_t *inst = array_at(cell->insts, phx_inst_t*, u);
+		for (unsigned v = 0; v < inst->cell->pins.size; ++v)
+			add_terminal(&ex, inst, array_at(inst->cell->pins, phx_pin_t*, v), &inst->xform);
+	}
+
+	// Join the geometry on each layer. The index reports the position of
+	// each box within the layer.
+	for (unsigned u = 0; u < ex.num_layers; ++u) {
+		extract_layer_t *layer = ex.layers + u;
+		if (!layer->tech)
+			continue;
+		uint32_t *ids = malloc(layer->boxes.size * sizeof(uint32_t));
+		for (unsigned v = 0; v < layer->boxes.size; ++v)
+			ids[v] = v;
+		phx_index_build(&layer->index, layer->boxes.size, layer->boxes.items, ids);
+		free(ids);
+		join_layers(&ex, layer, layer);
+	}
+
+	// Join the geometry connected by vias.
+	phx_tech_t *tech = cell->lib->tech;
+	for (unsigned u = 0, un = phx_tech_get_num_vias(tech); u < un; ++u) {
+		phx_tech_via_t *via = phx_tech_get_via(tech, u);
+		extract_layer_t *cut = find_layer(&ex, via->cut, false);
+		if (!cut)
+			continue;
+		extract_layer_t *below = find_layer(&ex, via->below, false);
+		extract_layer_t *above = find_layer(&ex, via->above, false);
+		if (below)
+			join_layers(&ex, cut, below);
+		if (above)
+			join_layers(&ex, cut, above);
+	}
+
+	// Number the groups that contain terminals, and sort the terminals by
+	// group.
+	uint32_t *groups = malloc(ex.parents.size * sizeof(uint32_t));
+	memset(groups, 0xFF, ex.parents.size * sizeof(uint32_t));
+	unsigned num_groups = 0;
+	for (unsigned u = 0; u < ex.terms.size; ++u) {
+		phx_extracted_terminal_t *term = array_get(&ex.terms, u);
+		uint32_t root = find_root(&ex, term->group);
+		if (groups[root] == UINT32_MAX)
+			groups[root] = num_groups++;
+		term->group = groups[root];
+	}
+	unsigned *counts = calloc(num_groups + 1, sizeof(unsigned));
+	for (unsigned u = 0; u < ex.terms.size; ++u)
+		++counts[array_at(ex.terms, phx_extracted_terminal_t, u).group + 1];
+	for (unsigned u = 0; u < num_groups; ++u)
+		counts[u+1] += counts[u];
+	unsigned base = out->size;
+	array_resize(out, base + ex.terms.size);
+	for (unsigned u = 0; u < ex.terms.size; ++u) {
+		phx_extracted_terminal_t *term = array_get(&ex.terms, u);
+		array_set(out, base + counts[term->group]++, term);
+	}
+	free(counts);
+	free(groups);
+
+	for (unsigned u = 0; u < ex.num_layers; ++u) {
+		extract_layer_t *layer = ex.layers + u;
+		if (!layer->tech)
+			continue;
+		array_dispose(&layer->boxes);
+		array_dispose(&layer->items);
+		array_dispose(&layer->pts);
+		phx_index_dispose(&layer->index);
+	}
+	free(ex.layers);
+	array_dispose(&ex.parents);
+	array_dispose(&ex.sizes);
+	array_dispose(&ex.terms);
+	return num_groups;
+}
@@ -1,5 +1,6 @@
 /* Copyright (c) 2016 Fabian Schuiki */
 #include "design-internal.h"
+#include "tech.h"
 
 
 /**
@@ -17,6 +18,18 @@ phx_geometry_init(phx_geometry_t *geo, phx_cell_t *cell) {
 	geo->invalid = PHX_INIT_INVALID;
 	geo->cell = cell;
 	array_init(&geo->layers, sizeof(phx_layer_t));
+	array_init(&geo->refs, sizeof(phx_geometry_ref_t));
+	pool_init(&geo->pool);
+}
+
+
+static void
+release_block(phx_geometry_block_t *block) {
+	assert(block && block->refs > 0);
+	if (--block->refs > 0)
+		return;
+	phx_geometry_dispose(&block->geo);
+	free(block);
 }
 
 
@@ -26,47 +39,102 @@ phx_geometry_dispose(phx_geometry_t *geo) {
 	for (size_t z = 0; z < geo->layers.size; ++z)
 		phx_layer_dispose(array_get(&geo->layers, z));
 	array_dispose(&geo->layers);
+	if (geo->layer_map)
+		free(geo->layer_map);
+	for (unsigned u = 0; u < geo->refs.size; ++u)
+		release_block(array_at(geo->refs, phx_geometry_ref_t, u).block);
+	array_dispose(&geo->refs);
+	pool_dispose(&geo->pool);
 }
 
 
 /**
- * Flag bits of a geometry as needing recalculation.
+ * Flag bits of a geometry as needing recalculation. The flattened geometry of
+ * a cell is derived from the cell, so changing it while it is being built
+ * does not invalidate the cell.
  */
 void
 phx_geometry_invalidate(phx_geometry_t *geo, uint8_t bits) {
 	assert(geo);
 	geo->invalid |= bits;
-	phx_cell_invalidate(geo->cell, bits);
+	if (geo != geo->cell->flat)
+		phx_cell_invalidate(geo->cell, bits);
+}
+
+
+/**
+ * Grow the extents of a geometry to include a box. See
+ * phx_cell_include_extents.
+ */
+void
+phx_geometry_include_extents(phx_geometry_t *geo, phx_extents_t *box) {
+	assert(geo && box);
+	if (geo->invalid & PHX_EXTENTS)
+		return;
+	if (phx_extents_include(&geo->ext, box) && geo != geo->cell->flat)
+		phx_cell_include_extents(geo->cell, box);
 }
 
 
-static int
-compare_layers(phx_layer_t *a, phx_layer_t *b) {
-	if (a->tech < b->tech) return -1;
-	if (a->tech > b->tech) return  1;
-	return 0;
+/**
+ * Find the layer of a geometry that corresponds to a technology layer.
+ *
+ * @return The layer, or `NULL` if the geometry has no such layer.
+ */
+phx_layer_t *
+phx_geometry_find_layer(phx_geometry_t *geo, phx_tech_layer_t *tech) {
+	assert(geo && tech);
+	if (tech->index >= geo->layer_map_size || geo->layer_map[tech->index] == 0)
+		return NULL;
+	return array_get(&geo->layers, geo->layer_map[tech->index] - 1);
 }
 
 
 phx_layer_t *
 phx_geometry_on_layer(phx_geometry_t *geo, phx_tech_layer_t *tech) {
 	phx_layer_t *layer;
-	assert(geo);
+	assert(geo && tech);
 
 	// Try to find the layer.
-	phx_layer_t key = { .tech = tech };
-	unsigned pos;
-	layer = array_bsearch(&geo->layers, &key, (void*)compare_layers, &pos);
+	layer = phx_geometry_find_layer(geo, tech);
 	if (layer)
 		return layer;
 
-	// Create the layer since none was found.
+	// Create the layer since none was found, and grow the map to cover all
+	// layers of the technology.
+	if (tech->index >= geo->layer_map_size) {
+		unsigned size = phx_tech_get_num_layer_indices(tech->tech);
+		geo->layer_map = realloc(geo->layer_map, size * sizeof(unsigned));
+		memset(geo->layer_map + geo->layer_map_size, 0, (size - geo->layer_map_size) * sizeof(unsigned));
+		geo->layer_map_size = size;
+	}
 	layer = array_add(&geo->layers, NULL);
 	phx_layer_init(layer, geo, tech);
+	geo->layer_map[tech->index] = geo->layers.size;
 	return layer;
 }
 
 
+/**
+ * Calculate the extents of a referenced block in the referencing geometry's
+ * coordinate space.
+ *
+ * @return `false` if the block contains no geometry.
+ */
+static bool
+ref_extents(phx_geometry_t *geo, phx_geometry_ref_t *ref, phx_extents_t *out) {
+	phx_geometry_update(&ref->block->geo, PHX_EXTENTS);
+	phx_extents_t *ext = &ref->block->geo.ext;
+	if (ext->min.x > ext->max.x || ext->min.y > ext->max.y)
+		return false;
+	double dbu = phx_library_get_dbu(geo->cell->lib);
+	phx_extents_reset(out);
+	phx_extents_add(out, phx_xform_apply_vec(&ref->xf, ext->min, dbu));
+	phx_extents_add(out, phx_xform_apply_vec(&ref->xf, ext->max, dbu));
+	return true;
+}
+
+
 static void
 phx_geometry_update_extents(phx_geometry_t *geo) {
 	assert(geo);
@@ -78,6 +146,11 @@ phx_geometry_update_extents(phx_geometry_t *geo) {
 		phx_layer_update(layer, PHX_EXTENTS);
 		phx_extents_include(&geo->ext, &layer->ext);
 	}
+	for (unsigned u = 0; u < geo->refs.size; ++u) {
+		phx_extents_t ext;
+		if (ref_extents(geo, array_get(&geo->refs, u), &ext))
+			phx_extents_include(&geo->ext, &ext);
+	}
 }
 
 
@@ -106,26 +179,125 @@ phx_geometry_get_layer(phx_geometry_t *geo, unsigned idx) {
 }
 
 
+static void
+add_ref(phx_geometry_t *geo, phx_geometry_block_t *block, phx_xform_t xf) {
+	phx_geometry_ref_t ref = { block, xf };
+	++block->refs;
+	array_add(&geo->refs, &ref);
+	phx_geometry_invalidate(geo, PHX_FLAT);
+	phx_extents_t ext;
+	if (ref_extents(geo, &ref, &ext))
+		phx_geometry_include_extents(geo, &ext);
+}
+
+
+/**
+ * Move the layers of a geometry into a new shared block, and replace them
+ * with a reference to that block. The contents of the geometry remain the
+ * same. Geometry added afterwards is stored in the geometry itself again.
+ */
+static void
+freeze(phx_geometry_t *geo) {
+	if (geo->layers.size == 0)
+		return;
+	phx_geometry_block_t *block = malloc(sizeof(*block));
+	block->refs = 0;
+	block->geo = *geo;
+	array_init(&block->geo.refs, sizeof(phx_geometry_ref_t));
+	for (unsigned u = 0; u < block->geo.layers.size; ++u)
+		array_at(block->geo.layers, phx_layer_t, u).geo = &block->geo;
+
+	array_init(&geo->layers, sizeof(phx_layer_t));
+	geo->layer_map = NULL;
+	geo->layer_map_size = 0;
+	pool_init(&geo->pool);
+	phx_geometry_ref_t ref = { block, phx_xform_identity() };
+	++block->refs;
+	array_add(&geo->refs, &ref);
+}
+
+
+/**
+ * Add the contents of one geometry to another, transformed by @a xf, without
+ * copying them. The layers of @a src are moved into a shared block that both
+ * geometries reference, and the blocks @a src already references are
+ * referenced by @a dst as well. A private copy is only made once one of the
+ * geometries is modified in place, see phx_geometry_materialize.
+ */
+void
+phx_geometry_add_shared(phx_geometry_t *dst, phx_geometry_t *src, phx_xform_t *xf) {
+	assert(dst && src && xf && dst != src);
+	freeze(src);
+	for (unsigned u = 0; u < src->refs.size; ++u) {
+		phx_geometry_ref_t *ref = array_get(&src->refs, u);
+		add_ref(dst, ref->block, phx_xform_mul(*xf, ref->xf));
+	}
+}
+
+
+/**
+ * Replace the shared blocks a geometry references with private copies of
+ * their contents. Needs to be called before the existing contents of a
+ * geometry are modified in place.
+ */
+void
+phx_geometry_materialize(phx_geometry_t *geo) {
+	assert(geo);
+	for (unsigned u = 0; u < geo->refs.size; ++u) {
+		phx_geometry_ref_t *ref = array_get(&geo->refs, u);
+		phx_geometry_t *shared = &ref->block->geo;
+		for (unsigned v = 0; v < shared->layers.size; ++v) {
+			phx_layer_t *src = array_get(&shared->layers, v);
+			phx_layer_add_transformed(phx_geometry_on_layer(geo, src->tech), src, &ref->xf);
+		}
+		release_block(ref->block);
+	}
+	array_clear(&geo->refs);
+}
+
+
+unsigned
+phx_geometry_get_num_refs(phx_geometry_t *geo) {
+	assert(geo);
+	return geo->refs.size;
+}
+
+
+phx_geometry_ref_t *
+phx_geometry_get_ref(phx_geometry_t *geo, unsigned idx) {
+	assert(geo && idx < geo->refs.size);
+	return array_get(&geo->refs, idx);
+}
+
+
 void
 phx_layer_init(phx_layer_t *layer, phx_geometry_t *geo, phx_tech_layer_t *tech) {
 	assert(layer && tech);
-	layer->invalid = PHX_INIT_INVALID;
+	memset(layer, 0, sizeof(*layer));
+	// An empty layer has valid, empty extents. This lets geometry added to a
+	// new layer grow the extents of the geometry and cell incrementally.
+	layer->invalid = PHX_INIT_INVALID & ~PHX_EXTENTS;
+	phx_extents_reset(&layer->ext);
 	layer->geo = geo;
 	layer->tech = tech;
-	array_init(&layer->lines, sizeof(phx_line_t));
-	array_init(&layer->shapes, sizeof(phx_shape_t));
+	array_init(&layer->lines, sizeof(phx_line_t*));
+	array_init(&layer->shapes, sizeof(phx_shape_ref_t));
+	phx_rects_init(&layer->rects);
+	phx_index_init(&layer->index);
 }
 
 
+/**
+ * Dispose of a layer. The lines and shapes themselves are owned by the
+ * geometry's pool and released together with the geometry.
+ */
 void
 phx_layer_dispose(phx_layer_t *layer) {
 	assert(layer);
-	for (size_t z = 0; z < layer->lines.size; ++z)
-		free(array_at(layer->lines, phx_line_t*, z));
-	for (size_t z = 0; z < layer->shapes.size; ++z)
-		free(array_at(layer->shapes, phx_shape_t*, z));
 	array_dispose(&layer->lines);
 	array_dispose(&layer->shapes);
+	phx_rects_dispose(&layer->rects);
+	phx_index_dispose(&layer->index);
 }
 
 
@@ -136,36 +308,294 @@ void
 phx_layer_invalidate(phx_layer_t *layer, uint8_t bits) {
 	assert(layer);
 	layer->invalid |= bits;
-	phx_geometry_invalidate(layer->geo, bits);
+	if (bits & PHX_EXTENTS)
+		layer->invalid |= PHX_INDEX;
+	phx_geometry_invalidate(layer->geo, bits & ~PHX_INDEX);
+}
+
+
+/**
+ * Grow the extents of a layer to include a box. See phx_cell_include_extents.
+ */
+void
+phx_layer_include_extents(phx_layer_t *layer, phx_extents_t *box) {
+	assert(layer && box);
+	if (layer->invalid & PHX_EXTENTS)
+		return;
+	if (phx_extents_include(&layer->ext, box))
+		phx_geometry_include_extents(layer->geo, box);
 }
 
 
+/**
+ * Grow the extents of a layer to include a box given in database units.
+ */
+static void
+include_rect(phx_layer_t *layer, phx_rect_t rect) {
+	phx_library_t *lib = phx_layer_get_library(layer);
+	phx_extents_t box = {
+		phx_library_vec_from_dbu(lib, rect.min),
+		phx_library_vec_from_dbu(lib, rect.max),
+	};
+	phx_layer_include_extents(layer, &box);
+}
+
+
+/**
+ * Calculate the bounding box of a list of points, in database units.
+ */
+static phx_rect_t
+bounds_of_points(size_t num_pts, vec2i_t *pts) {
+	phx_rect_t r = { { INT32_MAX, INT32_MAX }, { INT32_MIN, INT32_MIN } };
+	for (size_t z = 0; z < num_pts; ++z) {
+		if (pts[z].x < r.min.x) r.min.x = pts[z].x;
+		if (pts[z].y < r.min.y) r.min.y = pts[z].y;
+		if (pts[z].x > r.max.x) r.max.x = pts[z].x;
+		if (pts[z].y > r.max.y) r.max.y = pts[z].y;
+	}
+	return r;
+}
+
+
+/**
+ * Add a line to a layer. The width and points are given in meters and are
+ * rounded to the library's database units.
+ */
 phx_line_t *
 phx_layer_add_line(phx_layer_t *layer, double width, size_t num_pts, vec2_t *pts) {
+	assert(layer && num_pts >= 2 && pts);
+	phx_library_t *lib = phx_layer_get_library(layer);
+	vec2i_t pts_dbu[num_pts];
+	for (size_t z = 0; z < num_pts; ++z)
+		pts_dbu[z] = phx_library_vec_to_dbu(lib, pts[z]);
+	return phx_layer_add_line_dbu(layer, phx_library_to_dbu(lib, width), num_pts, pts_dbu);
+}
+
+
+/**
+ * Add a shape to a layer. The points are given in meters and are rounded to
+ * the library's database units. Shapes that are axis-aligned rectangles are
+ * stored as such.
+ */
+void
+phx_layer_add_shape(phx_layer_t *layer, size_t num_pts, vec2_t *pts) {
+	assert(layer && num_pts >= 3 && pts);
+	phx_library_t *lib = phx_layer_get_library(layer);
+	vec2i_t pts_dbu[num_pts];
+	for (size_t z = 0; z < num_pts; ++z)
+		pts_dbu[z] = phx_library_vec_to_dbu(lib, pts[z]);
+	phx_layer_add_shape_dbu(layer, num_pts, pts_dbu);
+}
+
+
+/**
+ * Add an axis-aligned rectangle to a layer. The corners are given in meters
+ * and are rounded to the library's database units.
+ */
+void
+phx_layer_add_rect(phx_layer_t *layer, vec2_t a, vec2_t b) {
+	assert(layer);
+	phx_library_t *lib = phx_layer_get_library(layer);
+	vec2i_t ai = phx_library_vec_to_dbu(lib, a);
+	vec2i_t bi = phx_library_vec_to_dbu(lib, b);
+	phx_layer_add_rect_dbu(layer, (phx_rect_t){
+		{ ai.x < bi.x ? ai.x : bi.x, ai.y < bi.y ? ai.y : bi.y },
+		{ ai.x > bi.x ? ai.x : bi.x, ai.y > bi.y ? ai.y : bi.y },
+	});
+}
+
+
+/**
+ * Add a line to a layer. The width and points are given in database units.
+ */
+phx_line_t *
+phx_layer_add_line_dbu(phx_layer_t *layer, int32_t width, size_t num_pts, vec2i_t *pts) {
 	assert(layer && num_pts >= 2);
-	size_t sz_pts = num_pts * sizeof(vec2_t);
-	phx_line_t *line = calloc(1, sizeof(*line) + sz_pts);
+	size_t sz_pts = num_pts * sizeof(vec2i_t);
+	phx_line_t *line = pool_calloc(&layer->geo->pool, sizeof(*line) + sz_pts);
 	line->width = width;
 	line->num_pts = num_pts;
-	if (pts)
-		memcpy(line->pts, pts, sz_pts);
-	phx_layer_invalidate(layer, PHX_EXTENTS);
 	array_add(&layer->lines, &line);
+	phx_layer_invalidate(layer, PHX_INDEX | PHX_FLAT);
+
+	// Lines added without points are populated later, so their extents are
+	// not known yet.
+	if (pts) {
+		memcpy(line->pts, pts, sz_pts);
+		phx_library_t *lib = phx_layer_get_library(layer);
+		phx_rect_t r = bounds_of_points(num_pts, pts);
+		double hw = phx_library_from_dbu(lib, width) / 2;
+		phx_extents_t box = {
+			vec2_sub(phx_library_vec_from_dbu(lib, r.min), VEC2(hw, hw)),
+			vec2_add(phx_library_vec_from_dbu(lib, r.max), VEC2(hw, hw)),
+		};
+		phx_layer_include_extents(layer, &box);
+	} else {
+		phx_layer_invalidate(layer, PHX_EXTENTS);
+	}
 	return line;
 }
 
 
-phx_shape_t *
-phx_layer_add_shape(phx_layer_t *layer, size_t num_pts, vec2_t *pts) {
-	assert(layer && num_pts >= 3);
-	size_t sz_pts = num_pts * sizeof(vec2_t);
-	phx_shape_t *shape = calloc(1, sizeof(*shape) + sz_pts);
-	shape->num_pts = num_pts;
-	if (pts)
-		memcpy(shape->pts, pts, sz_pts);
-	phx_layer_invalidate(layer, PHX_EXTENTS);
-	array_add(&layer->shapes, &shape);
-	return shape;
+/**
+ * Add a shape to a layer. The points are given in database units. Shapes that
+ * are axis-aligned rectangles are stored as such.
+ */
+void
+phx_layer_add_shape_dbu(phx_layer_t *layer, size_t num_pts, vec2i_t *pts) {
+	assert(layer && num_pts >= 3 && pts);
+	phx_rect_t rect;
+	if (phx_rect_from_points(num_pts, pts, &rect)) {
+		phx_layer_add_rect_dbu(layer, rect);
+		return;
+	}
+	phx_library_t *lib = phx_layer_get_library(layer);
+	phx_shape_ref_t ref;
+	if (lib->shapes) {
+		ref.shape = phx_shape_table_intern(lib->shapes, layer->tech, num_pts, pts, &ref.off);
+	} else {
+		size_t sz_pts = num_pts * sizeof(vec2i_t);
+		ref.shape = pool_alloc(&layer->geo->pool, sizeof(*ref.shape) + sz_pts);
+		ref.shape->num_pts = num_pts;
+		ref.shape->interned = false;
+		memcpy(ref.shape->pts, pts, sz_pts);
+		ref.off = (vec2i_t){ 0, 0 };
+	}
+	array_add(&layer->shapes, &ref);
+	phx_layer_invalidate(layer, PHX_INDEX | PHX_FLAT);
+	include_rect(layer, bounds_of_points(num_pts, pts));
+}
+
+
+/**
+ * Add an axis-aligned rectangle to a layer. The rectangle is given in database
+ * units.
+ */
+void
+phx_layer_add_rect_dbu(phx_layer_t *layer, phx_rect_t rect) {
+	assert(layer && rect.min.x <= rect.max.x && rect.min.y <= rect.max.y);
+	phx_rects_add(&layer->rects, rect);
+	phx_layer_invalidate(layer, PHX_INDEX | PHX_FLAT);
+	include_rect(layer, rect);
+}
+
+
+/**
+ * Add a list of rectangles to a layer at once. The rectangles are given in
+ * database units.
+ */
+void
+phx_layer_add_rects_dbu(phx_layer_t *layer, phx_rects_t *rects) {
+	assert(layer && rects);
+	phx_rect_t bounds;
+	if (!phx_rects_get_bounds(rects, &bounds))
+		return;
+	phx_rects_t *dst = &layer->rects;
+	phx_rects_reserve(dst, dst->size + rects->size);
+	size_t sz = rects->size * sizeof(int32_t);
+	memcpy(dst->xmin + dst->size, rects->xmin, sz);
+	memcpy(dst->ymin + dst->size, rects->ymin, sz);
+	memcpy(dst->xmax + dst->size, rects->xmax, sz);
+	memcpy(dst->ymax + dst->size, rects->ymax, sz);
+	dst->size += rects->size;
+	phx_layer_invalidate(layer, PHX_INDEX | PHX_FLAT);
+	include_rect(layer, bounds);
+}
+
+
+/**
+ * Add a shape that is already interned by the library to a layer, placed at
+ * offset @a off.
+ */
+void
+phx_layer_add_shape_ref(phx_layer_t *layer, phx_shape_t *shape, vec2i_t off) {
+	assert(layer && shape && shape->interned);
+	phx_shape_ref_t ref = { shape, off };
+	array_add(&layer->shapes, &ref);
+	phx_layer_invalidate(layer, PHX_INDEX | PHX_FLAT);
+	phx_rect_t bounds = bounds_of_points(shape->num_pts, shape->pts);
+	bounds.min.x += off.x;
+	bounds.min.y += off.y;
+	bounds.max.x += off.x;
+	bounds.max.y += off.y;
+	include_rect(layer, bounds);
+}
+
+
+/**
+ * Add all lines, shapes, and rectangles of one layer to another, transforming
+ * them on the way. The points are transformed directly into their new storage
+ * in batches, and the extents of the destination are grown by the transformed
+ * extents of the source.
+ */
+void
+phx_layer_add_transformed(phx_layer_t *dst, phx_layer_t *src, phx_xform_t *xf) {
+	assert(dst && src && xf && dst != src);
+	pool_t *pool = &dst->geo->pool;
+
+	// Lines
+	for (size_t z = 0; z < src->lines.size; ++z) {
+		phx_line_t *line_src = array_at(src->lines, phx_line_t*, z);
+		phx_line_t *line = pool_alloc(pool, sizeof(*line) + line_src->num_pts * sizeof(vec2i_t));
+		line->width = line_src->width;
+		line->num_pts = line_src->num_pts;
+		phx_xform_apply_many(xf, line->num_pts, line_src->pts, line->pts);
+		array_add(&dst->lines, &line);
+	}
+
+	// Shapes. Transformations preserve whether a shape is a rectangle, so the
+	// shapes need not be checked again. Only the offset of a shape is moved,
+	// its points are rotated and mirrored. Interned shapes that are only
+	// moved can be reused as they are, all others are interned anew since the
+	// lowest point may have changed. Shapes interned by another library's
+	// table are interned anew as well, since they are owned by that table.
+	phx_shape_table_t *table = phx_layer_get_library(dst)->shapes;
+	phx_xform_t linear = *xf;
+	linear.off = (vec2i_t){ 0, 0 };
+	bool moved_only = xf->xx == 1 && xf->xy == 0 && xf->yx == 0 && xf->yy == 1;
+	bool same_table = table && phx_layer_get_library(src)->shapes == table;
+	vec2i_t *buf = NULL;
+	size_t buf_size = 0;
+	for (size_t z = 0; z < src->shapes.size; ++z) {
+		phx_shape_ref_t *ref_src = array_get(&src->shapes, z);
+		phx_shape_t *shape_src = ref_src->shape;
+		phx_shape_ref_t ref = { NULL, phx_xform_apply(xf, ref_src->off) };
+		if (same_table && moved_only && shape_src->interned) {
+			ref.shape = shape_src;
+		} else if (table) {
+			if (shape_src->num_pts > buf_size) {
+				buf_size = shape_src->num_pts;
+				buf = realloc(buf, buf_size * sizeof(vec2i_t));
+			}
+			phx_xform_apply_many(&linear, shape_src->num_pts, shape_src->pts, buf);
+			vec2i_t shift;
+			ref.shape = phx_shape_table_intern(table, dst->tech, shape_src->num_pts, buf, &shift);
+			ref.off.x += shift.x;
+			ref.off.y += shift.y;
+		} else {
+			ref.shape = pool_alloc(pool, sizeof(*ref.shape) + shape_src->num_pts * sizeof(vec2i_t));
+			ref.shape->num_pts = shape_src->num_pts;
+			ref.shape->interned = false;
+			phx_xform_apply_many(&linear, shape_src->num_pts, shape_src->pts, ref.shape->pts);
+		}
+		array_add(&dst->shapes, &ref);
+	}
+	if (buf)
+		free(buf);
+
+	// Rectangles
+	phx_xform_apply_rects(xf, &src->rects, &dst->rects);
+
+	if (src->lines.size == 0 && src->shapes.size == 0 && src->rects.size == 0)
+		return;
+	phx_layer_invalidate(dst, PHX_INDEX | PHX_FLAT);
+	phx_layer_update(src, PHX_EXTENTS);
+	double dbu = phx_library_get_dbu(phx_layer_get_library(dst));
+	phx_extents_t box;
+	phx_extents_reset(&box);
+	phx_extents_add(&box, phx_xform_apply_vec(xf, src->ext.min, dbu));
+	phx_extents_add(&box, phx_xform_apply_vec(xf, src->ext.max, dbu));
+	phx_layer_include_extents(dst, &box);
 }
 
 
@@ -183,6 +613,13 @@ phx_layer_get_num_shapes(phx_layer_t *layer) {
 }
 
 
+size_t
+phx_layer_get_num_rects(phx_layer_t *layer) {
+	assert(layer);
+	return layer->rects.size;
+}
+
+
 phx_line_t *
 phx_layer_get_line(phx_layer_t *layer, size_t idx) {
 	assert(layer && idx < layer->lines.size);
@@ -190,10 +627,61 @@ phx_layer_get_line(phx_layer_t *layer, size_t idx) {
 }
 
 
+/**
+ * Get a shape on a layer. The shape's points are relative to the offset
+ * returned by phx_layer_get_shape_offset.
+ */
 phx_shape_t *
 phx_layer_get_shape(phx_layer_t *layer, size_t idx) {
 	assert(layer && idx < layer->shapes.size);
-	return array_at(layer->shapes, phx_shape_t*, idx);
+	return array_at(layer->shapes, phx_shape_ref_t, idx).shape;
+}
+
+
+vec2i_t
+phx_layer_get_shape_offset(phx_layer_t *layer, size_t idx) {
+	assert(layer && idx < layer->shapes.size);
+	return array_at(layer->shapes, phx_shape_ref_t, idx).off;
+}
+
+
+phx_rect_t
+phx_layer_get_rect(phx_layer_t *layer, size_t idx) {
+	assert(layer);
+	return phx_rects_get(&layer->rects, idx);
+}
+
+
+/**
+ * Get the bounding box of a rectangle, shape, or line on a layer, in database
+ * units. The box of a line includes half the line's width on either side.
+ */
+phx_rect_t
+phx_layer_get_bounds(phx_layer_t *layer, phx_layer_item_t kind, size_t idx) {
+	assert(layer);
+	switch (kind) {
+		case PHX_LAYER_RECT:
+			return phx_layer_get_rect(layer, idx);
+		case PHX_LAYER_SHAPE: {
+			phx_shape_ref_t *ref = array_get(&layer->shapes, idx);
+			phx_rect_t r = bounds_of_points(ref->shape->num_pts, ref->shape->pts);
+			return (phx_rect_t){
+				{ r.min.x + ref->off.x, r.min.y + ref->off.y },
+				{ r.max.x + ref->off.x, r.max.y + ref->off.y },
+			};
+		}
+		case PHX_LAYER_LINE: {
+			phx_line_t *line = phx_layer_get_line(layer, idx);
+			int32_t hw = (line->width + 1) / 2;
+			phx_rect_t r = bounds_of_points(line->num_pts, line->pts);
+			return (phx_rect_t){
+				{ r.min.x - hw, r.min.y - hw },
+				{ r.max.x + hw, r.max.y + hw },
+			};
+		}
+	}
+	assert(0 && "invalid layer item kind");
+	return (phx_rect_t){ { 0, 0 }, { 0, 0 } };
 }
 
 
@@ -202,25 +690,83 @@ phx_layer_update_extents(phx_layer_t *layer) {
 	assert(layer);
 	layer->invalid &= ~PHX_EXTENTS;
 	phx_extents_reset(&layer->ext);
+	phx_library_t *lib = phx_layer_get_library(layer);
 
 	// Lines
 	for (size_t z = 0; z < layer->lines.size; ++z) {
 		phx_line_t *line = array_at(layer->lines, phx_line_t*, z);
-		double hw = line->width / 2;
+		double hw = phx_library_from_dbu(lib, line->width) / 2;
 		for (size_t z = 0; z < line->num_pts; ++z) {
-			vec2_t pt = line->pts[z];
+			vec2_t pt = phx_library_vec_from_dbu(lib, line->pts[z]);
 			phx_extents_add(&layer->ext, (vec2_t){ pt.x - hw, pt.y - hw });
 			phx_extents_add(&layer->ext, (vec2_t){ pt.x + hw, pt.y + hw });
 		}
 	}
 
-	// Shapes
+	// Rectangles and shapes. The bounds are accumulated in database units and
+	// only converted to meters at the end.
+	vec2i_t min = { INT32_MAX, INT32_MAX }, max = { INT32_MIN, INT32_MIN };
+	phx_rect_t bounds;
+	if (phx_rects_get_bounds(&layer->rects, &bounds)) {
+		min = bounds.min;
+		max = bounds.max;
+	}
 	for (size_t z = 0; z < layer->shapes.size; ++z) {
-		phx_shape_t *shape = array_at(layer->shapes, phx_shape_t*, z);
-		for (size_t z = 0; z < shape->num_pts; ++z) {
-			phx_extents_add(&layer->ext, shape->pts[z]);
+		phx_shape_ref_t *ref = array_get(&layer->shapes, z);
+		for (size_t z = 0; z < ref->shape->num_pts; ++z) {
+			vec2i_t pt = { ref->shape->pts[z].x + ref->off.x, ref->shape->pts[z].y + ref->off.y };
+			if (pt.x < min.x) min.x = pt.x;
+			if (pt.y < min.y) min.y = pt.y;
+			if (pt.x > max.x) max.x = pt.x;
+			if (pt.y > max.y) max.y = pt.y;
 		}
 	}
+	if (layer->shapes.size > 0 || layer->rects.size > 0) {
+		phx_extents_add(&layer->ext, phx_library_vec_from_dbu(lib, min));
+		phx_extents_add(&layer->ext, phx_library_vec_from_dbu(lib, max));
+	}
+}
+
+
+/**
+ * The bits of a spatial index identifier that hold the item's position in the
+ * layer's list of rectangles, shapes, or lines. The remaining upper bits hold
+ * the kind of item.
+ */
+#define INDEX_ID_BITS 30
+#define INDEX_ID_MASK ((1u << INDEX_ID_BITS) - 1)
+
+
+static void
+phx_layer_update_index(phx_layer_t *layer) {
+	assert(layer);
+	layer->invalid &= ~PHX_INDEX;
+
+	unsigned num_rects = layer->rects.size;
+	unsigned num_shapes = layer->shapes.size;
+	unsigned num_lines = layer->lines.size;
+	unsigned num = num_rects + num_shapes + num_lines;
+	assert(num <= INDEX_ID_MASK);
+	phx_rect_t *boxes = malloc(num * sizeof(phx_rect_t));
+	uint32_t *ids = malloc(num * sizeof(uint32_t));
+	unsigned n = 0;
+
+	for (unsigned u = 0; u < num_rects; ++u, ++n) {
+		boxes[n] = phx_rects_get(&layer->rects, u);
+		ids[n] = (uint32_t)PHX_LAYER_RECT << INDEX_ID_BITS | u;
+	}
+	for (unsigned u = 0; u < num_shapes; ++u, ++n) {
+		boxes[n] = phx_layer_get_bounds(layer, PHX_LAYER_SHAPE, u);
+		ids[n] = (uint32_t)PHX_LAYER_SHAPE << INDEX_ID_BITS | u;
+	}
+	for (unsigned u = 0; u < num_lines; ++u, ++n) {
+		boxes[n] = phx_layer_get_bounds(layer, PHX_LAYER_LINE, u);
+		ids[n] = (uint32_t)PHX_LAYER_LINE << INDEX_ID_BITS | u;
+	}
+
+	phx_index_build(&layer->index, num, boxes, ids);
+	free(boxes);
+	free(ids);
 }
 
 
@@ -229,6 +775,39 @@ phx_layer_update(phx_layer_t *layer, uint8_t bits) {
 	assert(layer);
 	if (layer->invalid & bits & PHX_EXTENTS)
 		phx_layer_update_extents(layer);
+	if (layer->invalid & bits & PHX_INDEX)
+		phx_layer_update_index(layer);
+}
+
+
+struct layer_query {
+	phx_layer_t *layer;
+	void (*cb)(void*, phx_layer_t*, phx_layer_item_t, size_t);
+	void *arg;
+};
+
+
+static void
+layer_query_hit(void *arg, uint32_t id) {
+	struct layer_query *q = arg;
+	q->cb(q->arg, q->layer, id >> INDEX_ID_BITS, id & INDEX_ID_MASK);
+}
+
+
+/**
+ * Find the geometry on a layer whose bounding box overlaps or touches a
+ * region. The callback is called with @a arg, the layer, and the kind and
+ * index of each rectangle, shape, or line found. The spatial index of the
+ * layer is rebuilt first if the layer was modified since the last query.
+ *
+ * @param box  The region to search, in database units.
+ */
+void
+phx_layer_query(phx_layer_t *layer, phx_rect_t box, void (*cb)(void*, phx_layer_t*, phx_layer_item_t, size_t), void *arg) {
+	assert(layer && cb);
+	phx_layer_update(layer, PHX_INDEX);
+	struct layer_query q = { layer, cb, arg };
+	phx_index_query(&layer->index, box, layer_query_hit, &q);
 }
 
 
@@ -237,3 +816,69 @@ phx_layer_get_tech(phx_layer_t *layer) {
 	assert(layer);
 	return layer->tech;
 }
+
+
+static bool
+equal_points(size_t num_pts, vec2i_t *a, vec2i_t off_a, vec2i_t *b, vec2i_t off_b) {
+	for (size_t z = 0; z < num_pts; ++z)
+		if (a[z].x + off_a.x != b[z].x + off_b.x || a[z].y + off_a.y != b[z].y + off_b.y)
+			return false;
+	return true;
+}
+
+
+/**
+ * Check whether two layers contain the same geometry, in the same order.
+ * Shapes interned by the same table are compared by pointer, all other
+ * geometry point by point.
+ */
+bool
+phx_layer_equal(phx_layer_t *a, phx_layer_t *b) {
+	assert(a && b);
+	if (a->tech != b->tech ||
+	    a->rects.size != b->rects.size ||
+	    a->shapes.size != b->shapes.size ||
+	    a->lines.size != b->lines.size)
+		return false;
+
+	size_t sz = a->rects.size * sizeof(int32_t);
+	if (sz > 0 && (memcmp(a->rects.xmin, b->rects.xmin, sz) != 0 ||
+	    memcmp(a->rects.ymin, b->rects.ymin, sz) != 0 ||
+	    memcmp(a->rects.xmax, b->rects.xmax, sz) != 0 ||
+	    memcmp(a->rects.ymax, b->rects.ymax, sz) != 0))
+		return false;
+
+	bool same_table = a->shapes.size > 0 &&
+		phx_layer_get_library(a)->shapes == phx_layer_get_library(b)->shapes;
+	for (size_t z = 0; z < a->shapes.size; ++z) {
+		phx_shape_ref_t *sa = array_get(&a->shapes, z), *sb = array_get(&b->shapes, z);
+		if (sa->shape == sb->shape) {
+			if (sa->off.x != sb->off.x || sa->off.y != sb->off.y)
+				return false;
+		} else if ((same_table && sa->shape->interned && sb->shape->interned) ||
+		           sa->shape->num_pts != sb->shape->num_pts ||
+		           !equal_points(sa->shape->num_pts, sa->shape->pts, sa->off, sb->shape->pts, sb->off)) {
+			return false;
+		}
+	}
+
+	vec2i_t zero = { 0, 0 };
+	for (size_t z = 0; z < a->lines.size; ++z) {
+		phx_line_t *la = array_at(a->lines, phx_line_t*, z);
+		phx_line_t *lb = array_at(b->lines, phx_line_t*, z);
+		if (la->width != lb->width || la->num_pts != lb->num_pts ||
+		    !equal_points(la->num_pts, la->pts, zero, lb->pts, zero))
+			return false;
+	}
+	return true;
+}
+
+
+/**
+ * Get the library whose database units the layer's geometry is expressed in.
+ */
+phx_library_t *
+phx_layer_get_library(phx_layer_t *layer) {
+	assert(layer && layer->geo && layer->geo->cell);
+	return layer->geo->cell->lib;
+}
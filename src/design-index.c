@@ -0,0 +1,183 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#include "design-internal.h"
+
+/**
+ * @file
+ *
+ * This file implements a static R-tree used to find geometry that overlaps a
+ * region. The tree is bulk-loaded with the Sort-Tile-Recursive algorithm:
+ * the items are sorted into vertical slices by the x coordinate of their
+ * center, and each slice is sorted by the y coordinate. Consecutive runs of
+ * items then form the leaves, and consecutive runs of nodes form the levels
+ * above, such that the tree can be stored as a flat array of boxes without
+ * any child pointers.
+ */
+
+#define F PHX_INDEX_FANOUT
+
+
+typedef struct index_entry {
+	phx_rect_t box;
+	uint32_t id;
+} index_entry_t;
+
+
+static int
+compare_center_x(const void *pa, const void *pb) {
+	const index_entry_t *a = pa, *b = pb;
+	int64_t ca = (int64_t)a->box.min.x + a->box.max.x;
+	int64_t cb = (int64_t)b->box.min.x + b->box.max.x;
+	return (ca > cb) - (ca < cb);
+}
+
+
+static int
+compare_center_y(const void *pa, const void *pb) {
+	const index_entry_t *a = pa, *b = pb;
+	int64_t ca = (int64_t)a->box.min.y + a->box.max.y;
+	int64_t cb = (int64_t)b->box.min.y + b->box.max.y;
+	return (ca > cb) - (ca < cb);
+}
+
+
+void
+phx_index_init(phx_index_t *index) {
+	assert(index);
+	memset(index, 0, sizeof(*index));
+}
+
+
+void
+phx_index_dispose(phx_index_t *index) {
+	assert(index);
+	if (index->boxes)
+		free(index->boxes);
+	if (index->ids)
+		free(index->ids);
+	memset(index, 0, sizeof(*index));
+}
+
+
+/**
+ * Rebuild an index from scratch. Any previous contents are discarded.
+ *
+ * @param num_items  The number of items to be indexed.
+ * @param boxes      The bounding box of each item.
+ * @param ids        The identifier of each item, reported by queries.
+ */
+void
+phx_index_build(phx_index_t *index, unsigned num_items, phx_rect_t *boxes, uint32_t *ids) {
+	assert(index && (num_items == 0 || (boxes && ids)));
+	phx_index_dispose(index);
+	if (num_items == 0)
+		return;
+
+	// Sort the items into slices along x, then each slice along y.
+	index_entry_t *entries = malloc(num_items * sizeof(*entries));
+	for (unsigned u = 0; u < num_items; ++u) {
+		entries[u].box = boxes[u];
+		entries[u].id = ids[u];
+	}
+	unsigned num_leaves = (num_items + F - 1) / F;
+	unsigned num_slices = ceil(sqrt(num_leaves));
+	unsigned slice_size = num_slices * F;
+	qsort(entries, num_items, sizeof(*entries), compare_center_x);
+	for (unsigned u = 0; u < num_items; u += slice_size) {
+		unsigned n = num_items - u < slice_size ? num_items - u : slice_size;
+		qsort(entries + u, n, sizeof(*entries), compare_center_y);
+	}
+
+	// Determine the number of levels and the number of nodes on each.
+	unsigned num_boxes = 0, n = num_items, level = 0;
+	for (;;) {
+		assert(level < PHX_INDEX_MAX_LEVELS);
+		index->level_start[level] = num_boxes;
+		index->level_size[level] = n;
+		num_boxes += n;
+		++level;
+		if (n == 1)
+			break;
+		n = (n + F - 1) / F;
+	}
+	index->num_items = num_items;
+	index->num_levels = level;
+	index->boxes = malloc(num_boxes * sizeof(phx_rect_t));
+	index->ids = malloc(num_items * sizeof(uint32_t));
+
+	for (unsigned u = 0; u < num_items; ++u) {
+		index->boxes[u] = entries[u].box;
+		index->ids[u] = entries[u].id;
+	}
+	free(entries);
+
+	// Calculate the boxes of each level from the level below.
+	for (unsigned l = 1; l < index->num_levels; ++l) {
+		phx_rect_t *below = index->boxes + index->level_start[l-1];
+		phx_rect_t *nodes = index->boxes + index->level_start[l];
+		unsigned num_below = index->level_size[l-1];
+		for (unsigned u = 0; u < index->level_size[l]; ++u) {
+			unsigned first = u * F;
+			unsigned last = first + F < num_below ? first + F : num_below;
+			phx_rect_t r = below[first];
+			for (unsigned v = first + 1; v < last; ++v) {
+				if (below[v].min.x < r.min.x) r.min.x = below[v].min.x;
+				if (below[v].min.y < r.min.y) r.min.y = below[v].min.y;
+				if (below[v].max.x > r.max.x) r.max.x = below[v].max.x;
+				if (below[v].max.y > r.max.y) r.max.y = below[v].max.y;
+			}
+			nodes[u] = r;
+		}
+	}
+}
+
+
+/**
+ * Find the items in an index whose bounding box overlaps or touches @a box.
+ * The callback is called with @a arg and the identifier of each item found.
+ */
+void
+phx_index_query(phx_index_t *index, phx_rect_t box, void (*cb)(void*, uint32_t), void *arg) {
+	assert(index && cb);
+	if (index->num_items == 0)
+		return;
+
+	unsigned root = index->num_levels - 1;
+	if (!phx_rect_overlaps(index->boxes[index->level_start[root]], box))
+		return;
+	if (root == 0) {
+		cb(arg, index->ids[0]);
+		return;
+	}
+
+	// Descend into the tree depth-first. Every node popped off the stack is
+	// known to overlap the box. Children are pushed in reverse order such that
+	// items are reported in tree order.
+	struct { unsigned level, node; } stack[PHX_INDEX_MAX_LEVELS * F];
+	unsigned sp = 0;
+	stack[sp].level = root;
+	stack[sp].node = 0;
+	++sp;
+
+	while (sp > 0) {
+		--sp;
+		unsigned level = stack[sp].level - 1, node = stack[sp].node;
+		phx_rect_t *children = index->boxes + index->level_start[level];
+		unsigned first = node * F;
+		unsigned last = first + F < index->level_size[level] ? first + F : index->level_size[level];
+
+		if (level == 0) {
+			for (unsigned u = first; u < last; ++u)
+				if (phx_rect_overlaps(children[u], box))
+					cb(arg, index->ids[u]);
+		} else {
+			for (unsigned u = last; u > first; --u) {
+				if (phx_rect_overlaps(children[u-1], box)) {
+					assert(sp < ASIZE(stack));
+					stack[sp].level = level;
+					stack[sp].node = u-1;
+					++sp;
+				}
+			}
+		}
+	}
+}
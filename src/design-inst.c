@@ -10,15 +10,28 @@
 
 
 /**
- * Flag bits of an instance as invalid.
+ * Flag bits of an instance as invalid, together with its parent cell and all
+ * cells further up the hierarchy.
  */
 void
 phx_inst_invalidate(phx_inst_t *inst, uint8_t bits) {
 	assert(inst);
-	if (~inst->invalid & bits) {
-		inst->invalid |= bits;
-		phx_cell_invalidate(inst->parent, bits);
-	}
+	inst->invalid |= bits;
+	phx_cell_invalidate(inst->parent, bits);
+}
+
+
+/**
+ * Transforms extents from the instance's to the parent's coordinate space.
+ */
+static phx_extents_t
+extents_to_parent(phx_inst_t *inst, phx_extents_t *ext) {
+	double dbu = phx_library_get_dbu(inst->parent->lib);
+	phx_extents_t out;
+	phx_extents_reset(&out);
+	phx_extents_add(&out, phx_xform_apply_vec(&inst->xform, ext->min, dbu));
+	phx_extents_add(&out, phx_xform_apply_vec(&inst->xform, ext->max, dbu));
+	return out;
 }
 
 
@@ -26,31 +39,24 @@ static void
 phx_inst_update_extents(phx_inst_t *inst) {
 	assert(inst);
 	inst->invalid &= ~PHX_EXTENTS;
+	inst->ext = extents_to_parent(inst, &inst->cell->ext);
+}
 
-	phx_extents_t ext = inst->cell->ext;
-	if (inst->orientation & PHX_MIRROR_X) {
-		double tmp = ext.min.x;
-		ext.min.x = -ext.max.x;
-		ext.max.x = -tmp;
-	}
-	if (inst->orientation & PHX_MIRROR_Y) {
-		double tmp = ext.min.y;
-		ext.min.y = -ext.max.y;
-		ext.max.y = -tmp;
-	}
-	if (inst->orientation & PHX_ROTATE_90) {
-		double tmp;
-		tmp = ext.min.x;
-		ext.min.x = ext.min.y;
-		ext.max.y = -tmp;
-		tmp = ext.max.x;
-		ext.max.x = ext.max.y;
-		ext.min.y = -tmp;
-	}
 
-	vec2_t off = vec2_sub(inst->pos, inst->cell->origin);
-	inst->ext.min = vec2_add(ext.min, off);
-	inst->ext.max = vec2_add(ext.max, off);
+/**
+ * Grow the extents of an instance to include a box, given in the instantiated
+ * cell's coordinate space. See phx_cell_include_extents.
+ */
+void
+phx_inst_include_extents(phx_inst_t *inst, phx_extents_t *box) {
+	assert(inst && box);
+	if (inst->invalid & PHX_EXTENTS)
+		return;
+	phx_extents_t ext = extents_to_parent(inst, box);
+	if (phx_extents_include(&inst->ext, &ext)) {
+		inst->parent->invalid |= PHX_INDEX;
+		phx_cell_include_extents(inst->parent, &ext);
+	}
 }
 
 
@@ -73,8 +79,9 @@ void
 phx_inst_set_orientation(phx_inst_t *inst, phx_orientation_t orientation) {
 	assert(inst);
 	if (inst->orientation != orientation) {
-		phx_inst_invalidate(inst, PHX_EXTENTS);
+		phx_inst_invalidate(inst, PHX_EXTENTS | PHX_FLAT);
 		inst->orientation = orientation;
+		phx_inst_update_xform(inst);
 	}
 }
 
@@ -130,33 +137,36 @@ phx_inst_vec_to_parent(phx_inst_t *inst, vec2_t pt) {
 
 
 /**
- * Copies the contents of one geometry into another, translating the coordinates
+ * Recalculate the transformation of an instance. Called whenever the instance's
+ * position or orientation, or the origin of the instantiated cell changes.
+ */
+void
+phx_inst_update_xform(phx_inst_t *inst) {
+	assert(inst);
+	vec2i_t off = phx_library_vec_to_dbu(inst->parent->lib, vec2_sub(inst->pos, inst->cell->origin));
+	inst->xform = phx_xform_from_orientation(inst->orientation, off);
+}
+
+
+/**
+ * Get the transformation that maps points in database units from the
+ * instance's to the parent's coordinate space.
+ */
+phx_xform_t
+phx_inst_get_xform(phx_inst_t *inst) {
+	assert(inst);
+	return inst->xform;
+}
+
+
+/**
+ * Adds the contents of one geometry to another, translating the coordinates
  * from the instance's to the parent's coordinate space. Useful e.g. to raise an
- * instance's pin to the parent.
+ * instance's pin to the parent. The geometry is shared rather than copied, see
+ * phx_geometry_add_shared.
  */
 void
 phx_inst_copy_geometry_to_parent(phx_inst_t *inst, phx_geometry_t *src, phx_geometry_t *dst) {
 	assert(inst && src && dst);
-	for (size_t z = 0; z < src->layers.size; ++z) {
-		phx_layer_t *layer_src = array_get(&src->layers, z);
-		phx_layer_t *layer_dst = phx_geometry_on_layer(dst, layer_src->tech);
-
-		// Lines
-		for (size_t z = 0; z < layer_src->lines.size; ++z) {
-			phx_line_t *line_src = array_at(layer_src->lines, phx_line_t*, z);
-			phx_line_t *line_dst = phx_layer_add_line(layer_dst, line_src->width, line_src->num_pts, line_src->pts);
-			for (size_t z = 0; z < line_src->num_pts; ++z) {
-				line_dst->pts[z] = phx_inst_vec_to_parent(inst, line_src->pts[z]);
-			}
-		}
-
-		// Shapes
-		for (size_t z = 0; z < layer_src->shapes.size; ++z) {
-			phx_shape_t *shape_src = array_at(layer_src->shapes, phx_shape_t*, z);
-			phx_shape_t *shape_dst = phx_layer_add_shape(layer_dst, shape_src->num_pts, shape_src->pts);
-			for (size_t z = 0; z < shape_src->num_pts; ++z) {
-				shape_dst->pts[z] = phx_inst_vec_to_parent(inst, shape_src->pts[z]);
-			}
-		}
-	}
+	phx_geometry_add_shared(dst, src, &inst->xform);
 }
@@ -7,3 +7,21 @@ void phx_inst_invalidate(phx_inst_t*, uint8_t);
 void phx_geometry_invalidate(phx_geometry_t*, uint8_t);
 void phx_layer_invalidate(phx_layer_t*, uint8_t);
 void phx_net_invalidate(phx_net_t*, uint8_t);
+
+void phx_inst_update_xform(phx_inst_t*);
+void phx_library_stop_pool(phx_library_t*);
+
+void phx_cell_include_extents(phx_cell_t*, phx_extents_t*);
+void phx_inst_include_extents(phx_inst_t*, phx_extents_t*);
+void phx_geometry_include_extents(phx_geometry_t*, phx_extents_t*);
+void phx_layer_include_extents(phx_layer_t*, phx_extents_t*);
+
+void phx_layer_add_shape_ref(phx_layer_t*, phx_shape_t*, vec2i_t);
+
+phx_shape_t *phx_shape_table_intern(phx_shape_table_t*, phx_tech_layer_t*, size_t, const vec2i_t*, vec2i_t*);
+void phx_shape_table_destroy(phx_shape_table_t*);
+size_t phx_shape_table_get_size(phx_shape_table_t*);
+
+uint64_t phx_trace_now(void);
+void phx_trace_update(phx_library_t*, phx_update_kind_t, phx_cell_t*, uint64_t);
+void phx_trace_hit(phx_library_t*, phx_update_kind_t, phx_cell_t*);
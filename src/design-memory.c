@@ -0,0 +1,210 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#include "design-internal.h"
+#include "table.h"
+#include "tech.h"
+
+/**
+ * @file
+ *
+ * This file implements the accounting of the memory held by a library. Rather
+ * than tracking every allocation, the data structures are traversed and the
+ * capacity of their arrays, maps, pools, and spatial indices is summed up.
+ * This reflects the memory that is actually reserved, including space that
+ * has not been filled yet.
+ */
+
+
+typedef struct measure {
+	phx_memory_report_t *report;
+	/// The shared objects that have been counted already.
+	ptrset_t blocks;
+	ptrset_t tables;
+	ptrset_t formats;
+	ptrset_t gds;
+} measure_t;
+
+
+static size_t
+array_bytes(array_t *array) {
+	return (size_t)array->capacity * array->item_size;
+}
+
+
+static size_t
+index_bytes(phx_index_t *index) {
+	size_t num_boxes = 0;
+	for (unsigned u = 0; u < index->num_levels; ++u)
+		num_boxes += index->level_size[u];
+	return num_boxes * sizeof(phx_rect_t) + index->num_items * sizeof(uint32_t);
+}
+
+
+/**
+ * Measure a layer. Lines and shapes live in the geometry's pool, which is
+ * counted by the caller; they are only attributed to the layer here.
+ */
+static size_t
+measure_layer(measure_t *m, phx_layer_t *layer) {
+	size_t own = (size_t)layer->rects.capacity * 4 * sizeof(int32_t) +
+		array_bytes(&layer->lines) +
+		array_bytes(&layer->shapes) +
+		index_bytes(&layer->index);
+	size_t pooled = 0;
+	for (unsigned u = 0; u < layer->lines.size; ++u) {
+		phx_line_t *line = array_at(layer->lines, phx_line_t*, u);
+		pooled += sizeof(*line) + line->num_pts * sizeof(vec2i_t);
+	}
+	for (unsigned u = 0; u < layer->shapes.size; ++u) {
+		phx_shape_ref_t *ref = array_get(&layer->shapes, u);
+		if (!ref->shape->interned)
+			pooled += sizeof(*ref->shape) + ref->shape->num_pts * sizeof(vec2i_t);
+	}
+
+	size_t *by_layer = array_get(&m->report->by_layer, layer->tech->index);
+	*by_layer += own + pooled;
+	return own;
+}
+
+
+/**
+ * Measure a geometry and the shared blocks it is first to reference.
+ *
+ * @return The number of bytes held by the geometry, excluding the geometry
+ * struct itself.
+ */
+static size_t
+measure_geometry(measure_t *m, phx_geometry_t *geo) {
+	size_t size = array_bytes(&geo->layers) +
+		geo->layer_map_size * sizeof(unsigned) +
+		array_bytes(&geo->refs) +
+		pool_get_size(&geo->pool);
+	for (unsigned u = 0; u < geo->layers.size; ++u)
+		size += measure_layer(m, array_get(&geo->layers, u));
+	for (unsigned u = 0; u < geo->refs.size; ++u) {
+		phx_geometry_ref_t *ref = array_get(&geo->refs, u);
+		if (ptrset_add(&m->blocks, ref->block))
+			size += sizeof(*ref->block) + measure_geometry(m, &ref->block->geo);
+	}
+	return size;
+}
+
+
+static size_t
+measure_table(measure_t *m, phx_table_t *tbl) {
+	if (!tbl || !ptrset_add(&m->tables, tbl))
+		return 0;
+	size_t size = sizeof(*tbl) + tbl->num_axes * sizeof(phx_table_axis_t);
+	if (tbl->num_axes > 0) {
+		for (unsigned u = 0; u < tbl->num_axes; ++u)
+			size += tbl->axes[u].num_indices * sizeof(phx_table_index_t);
+		size += tbl->size * sizeof(double);
+	} else {
+		size += (tbl->fmt ? tbl->fmt->num_values : 1) * sizeof(double);
+	}
+
+	phx_table_format_t *fmt = tbl->fmt;
+	if (fmt && ptrset_add(&m->formats, fmt)) {
+		size += sizeof(*fmt) + fmt->num_axes * sizeof(phx_table_axis_t);
+		for (unsigned u = 0; u < fmt->num_axes; ++u)
+			size += fmt->axes[u].num_indices * sizeof(phx_table_index_t);
+	}
+	return size;
+}
+
+
+static size_t
+measure_arcs(measure_t *m, array_t *arcs) {
+	for (unsigned u = 0; u < arcs->size; ++u) {
+		phx_timing_arc_t *arc = array_get(arcs, u);
+		m->report->tables += measure_table(m, arc->delay);
+		m->report->tables += measure_table(m, arc->transition);
+	}
+	return array_bytes(arcs);
+}
+
+
+static void
+measure_cell(measure_t *m, phx_cell_t *cell, size_t *total) {
+	phx_memory_report_t *report = m->report;
+	size_t structure = sizeof(*cell) +
+		array_bytes(&cell->insts) +
+		cell->insts.size * sizeof(phx_inst_t) +
+		cell->insts_by_name.capacity * sizeof(strmap_slot_t) +
+		array_bytes(&cell->pins) +
+		cell->pins.size * sizeof(phx_pin_t) +
+		cell->pins_by_name.capacity * sizeof(strmap_slot_t) +
+		array_bytes(&cell->nets) +
+		array_bytes(&cell->gds_text) +
+		cell->uses.capacity * sizeof(void*) +
+		measure_arcs(m, &cell->arcs);
+	for (unsigned u = 0; u < cell->nets.size; ++u) {
+		phx_net_t *net = array_at(cell->nets, phx_net_t*, u);
+		structure += sizeof(*net) + array_bytes(&net->conns) + measure_arcs(m, &net->arcs);
+	}
+	for (unsigned u = 0; u < cell->gds_text.size; ++u) {
+		phx_gds_text_t *text = array_at(cell->gds_text, phx_gds_text_t*, u);
+		structure += sizeof(*text) + strlen(text->text) + 1;
+	}
+
+	size_t geometry = measure_geometry(m, &cell->geo) + index_bytes(&cell->inst_index);
+	for (unsigned u = 0; u < cell->pins.size; ++u)
+		geometry += measure_geometry(m, &array_at(cell->pins, phx_pin_t*, u)->geo);
+	if (cell->flat)
+		geometry += sizeof(*cell->flat) + measure_geometry(m, cell->flat);
+
+	if (cell->gds && ptrset_add(&m->gds, cell->gds)) {
+		++report->num_gds;
+		report->num_gds_elems += gds_struct_get_num_elems(cell->gds);
+	}
+
+	report->cells += structure;
+	report->geometry += geometry;
+	*total = structure + geometry;
+}
+
+
+/**
+ * Determine how much memory a library holds, broken down by what it is used
+ * for, by cell, and by layer. The report must be disposed of with
+ * phx_memory_report_dispose.
+ */
+void
+phx_library_memory_report(phx_library_t *lib, phx_memory_report_t *report) {
+	assert(lib && report);
+	memset(report, 0, sizeof(*report));
+	array_init(&report->by_cell, sizeof(size_t));
+	array_init(&report->by_layer, sizeof(size_t));
+	array_resize(&report->by_cell, lib->cells.size);
+	array_resize(&report->by_layer, phx_tech_get_num_layer_indices(lib->tech));
+	for (unsigned u = 0; u < report->by_layer.size; ++u)
+		array_at(report->by_layer, size_t, u) = 0;
+
+	measure_t m;
+	m.report = report;
+	ptrset_init(&m.blocks);
+	ptrset_init(&m.tables);
+	ptrset_init(&m.formats);
+	ptrset_init(&m.gds);
+
+	report->cells = sizeof(*lib) + array_bytes(&lib->cells) +
+		array_bytes(&lib->dirty) + array_bytes(&lib->edited) +
+		lib->cells_by_name.capacity * sizeof(strmap_slot_t);
+	for (unsigned u = 0; u < lib->cells.size; ++u)
+		measure_cell(&m, array_at(lib->cells, phx_cell_t*, u), array_get(&report->by_cell, u));
+	if (lib->shapes)
+		report->shapes = phx_shape_table_get_size(lib->shapes);
+	report->names = intern_str_get_size();
+
+	ptrset_dispose(&m.blocks);
+	ptrset_dispose(&m.tables);
+	ptrset_dispose(&m.formats);
+	ptrset_dispose(&m.gds);
+}
+
+
+void
+phx_memory_report_dispose(phx_memory_report_t *report) {
+	assert(report);
+	array_dispose(&report->by_cell);
+	array_dispose(&report->by_layer);
+}
@@ -0,0 +1,269 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#include "design-internal.h"
+
+/**
+ * @file
+ *
+ * This file implements boolean operations on sets of axis-aligned rectangles.
+ * A vertical scanline sweeps across the rectangles from left to right. At
+ * every x coordinate where a rectangle starts or ends, the y intervals covered
+ * by the active rectangles are merged, and the result is compared against the
+ * intervals of the previous step. Intervals that remain unchanged are extended
+ * to the right, all others are emitted as rectangles. The output therefore
+ * consists of non-overlapping rectangles that are as wide as possible.
+ */
+
+
+typedef struct merge_event {
+	int32_t x;
+	int32_t ymin, ymax;
+	/// Which operand the rectangle belongs to, 0 or 1.
+	uint8_t set;
+	/// Whether the rectangle starts or ends at x.
+	bool start;
+} merge_event_t;
+
+typedef struct merge_interval {
+	int32_t min, max;
+} merge_interval_t;
+
+typedef struct merge_open {
+	int32_t ymin, ymax;
+	/// Where the rectangle started.
+	int32_t x;
+} merge_open_t;
+
+
+static int
+compare_events(const void *pa, const void *pb) {
+	const merge_event_t *a = pa, *b = pb;
+	if (a->x != b->x)
+		return (a->x > b->x) - (a->x < b->x);
+	// Rectangles starting at x come first, such that a rectangle is never
+	// removed before it was added.
+	return (int)b->start - (int)a->start;
+}
+
+
+static int
+compare_intervals(const merge_interval_t *a, const merge_interval_t *b) {
+	if (a->min != b->min)
+		return (a->min > b->min) - (a->min < b->min);
+	return (a->max > b->max) - (a->max < b->max);
+}
+
+
+/**
+ * Add or remove an interval from a list of active intervals, which is kept
+ * sorted.
+ */
+static void
+update_active(array_t *active, merge_event_t *ev) {
+	merge_interval_t iv = { ev->ymin, ev->ymax };
+	unsigned pos;
+	merge_interval_t *found = array_bsearch(active, &iv, (void*)compare_intervals, &pos);
+	if (ev->start) {
+		array_insert(active, pos, &iv);
+	} else {
+		assert(found);
+		array_erase(active, found - (merge_interval_t*)active->items);
+	}
+}
+
+
+/**
+ * Merge a sorted list of intervals into a list of disjoint intervals.
+ * Intervals that overlap or touch are combined.
+ *
+ * @return The number of intervals stored in @a out.
+ */
+static unsigned
+merge_intervals(array_t *active, merge_interval_t *out) {
+	unsigned n = 0;
+	for (unsigned u = 0; u < active->size; ++u) {
+		merge_interval_t iv = array_at(*active, merge_interval_t, u);
+		if (n > 0 && iv.min <= out[n-1].max) {
+			if (iv.max > out[n-1].max)
+				out[n-1].max = iv.max;
+		} else {
+			out[n++] = iv;
+		}
+	}
+	return n;
+}
+
+
+/**
+ * Subtract one list of disjoint intervals from another. Intervals of zero
+ * length are dropped from the result.
+ *
+ * @return The number of intervals stored in @a out.
+ */
+static unsigned
+subtract_intervals(merge_interval_t *a, unsigned num_a, merge_interval_t *b, unsigned num_b, merge_interval_t *out) {
+	unsigned n = 0, ib = 0;
+	for (unsigned ia = 0; ia < num_a; ++ia) {
+		int32_t min = a[ia].min, max = a[ia].max;
+		while (ib < num_b && b[ib].max <= min)
+			++ib;
+		for (unsigned u = ib; u < num_b && b[u].min < max; ++u) {
+			if (b[u].min > min)
+				out[n++] = (merge_interval_t){ min, b[u].min };
+			if (b[u].max > min)
+				min = b[u].max;
+		}
+		if (min < max)
+			out[n++] = (merge_interval_t){ min, max };
+	}
+	return n;
+}
+
+
+/**
+ * Sweep across the rectangles of @a a and, if not `NULL`, @a b. Stores the
+ * union of @a a, or the difference of @a a and @a b, in @a dst.
+ */
+static void
+sweep(phx_rects_t *a, phx_rects_t *b, phx_rects_t *dst) {
+	unsigned num_a = a->size, num_b = b ? b->size : 0;
+	unsigned num_events = 2 * (num_a + num_b);
+	if (num_a == 0)
+		return;
+
+	merge_event_t *events = malloc(num_events * sizeof(*events));
+	unsigned n = 0;
+	for (unsigned u = 0; u < num_a; ++u) {
+		events[n++] = (merge_event_t){ a->xmin[u], a->ymin[u], a->ymax[u], 0, true };
+		events[n++] = (merge_event_t){ a->xmax[u], a->ymin[u], a->ymax[u], 0, false };
+	}
+	for (unsigned u = 0; u < num_b; ++u) {
+		events[n++] = (merge_event_t){ b->xmin[u], b->ymin[u], b->ymax[u], 1, true };
+		events[n++] = (merge_event_t){ b->xmax[u], b->ymin[u], b->ymax[u], 1, false };
+	}
+	qsort(events, num_events, sizeof(*events), compare_events);
+
+	array_t active[2];
+	array_init(&active[0], sizeof(merge_interval_t));
+	array_init(&active[1], sizeof(merge_interval_t));
+	merge_interval_t *merged_a = malloc(num_a * sizeof(merge_interval_t));
+	merge_interval_t *merged_b = malloc(num_b * sizeof(merge_interval_t));
+	merge_interval_t *result = malloc((num_a + num_b) * sizeof(merge_interval_t));
+	merge_open_t *open = malloc((num_a + num_b) * sizeof(merge_open_t));
+	merge_open_t *next_open = malloc((num_a + num_b) * sizeof(merge_open_t));
+	unsigned num_open = 0;
+
+	for (unsigned ev = 0; ev < num_events;) {
+		int32_t x = events[ev].x;
+		for (; ev < num_events && events[ev].x == x; ++ev)
+			update_active(&active[events[ev].set], &events[ev]);
+
+		// Determine the intervals covered between x and the next event.
+		unsigned num_result = merge_intervals(&active[0], merged_a);
+		if (b) {
+			unsigned nb = merge_intervals(&active[1], merged_b);
+			num_result = subtract_intervals(merged_a, num_result, merged_b, nb, result);
+		} else {
+			unsigned na = num_result;
+			num_result = 0;
+			for (unsigned u = 0; u < na; ++u)
+				if (merged_a[u].min < merged_a[u].max)
+					result[num_result++] = merged_a[u];
+		}
+
+		// Extend the open rectangles whose interval is unchanged, close the
+		// others, and open new rectangles for the remaining intervals.
+		unsigned io = 0, ir = 0, num_next = 0;
+		while (io < num_open || ir < num_result) {
+			int cmp;
+			if (io == num_open)
+				cmp = 1;
+			else if (ir == num_result)
+				cmp = -1;
+			else
+				cmp = compare_intervals(&(merge_interval_t){ open[io].ymin, open[io].ymax }, &result[ir]);
+
+			if (cmp == 0) {
+				next_open[num_next++] = open[io++];
+				++ir;
+			} else if (cmp < 0) {
+				if (open[io].x < x)
+					phx_rects_add(dst, (phx_rect_t){ { open[io].x, open[io].ymin }, { x, open[io].ymax } });
+				++io;
+			} else {
+				next_open[num_next++] = (merge_open_t){ result[ir].min, result[ir].max, x };
+				++ir;
+			}
+		}
+		merge_open_t *tmp = open;
+		open = next_open;
+		next_open = tmp;
+		num_open = num_next;
+	}
+	assert(num_open == 0);
+
+	array_dispose(&active[0]);
+	array_dispose(&active[1]);
+	free(events);
+	free(merged_a);
+	free(merged_b);
+	free(result);
+	free(open);
+	free(next_open);
+}
+
+
+/**
+ * Calculate the union of a list of rectangles. The result is a list of
+ * non-overlapping rectangles that is appended to @a dst. Rectangles without
+ * area do not contribute to the result.
+ */
+void
+phx_rects_merge(phx_rects_t *src, phx_rects_t *dst) {
+	assert(src && dst && src != dst);
+	sweep(src, NULL, dst);
+}
+
+
+/**
+ * Calculate the area covered by the rectangles in @a a but not by the ones in
+ * @a b. The result is a list of non-overlapping rectangles that is appended to
+ * @a dst.
+ */
+void
+phx_rects_subtract(phx_rects_t *a, phx_rects_t *b, phx_rects_t *dst) {
+	assert(a && b && dst && a != dst && b != dst);
+	sweep(a, b, dst);
+}
+
+
+/**
+ * Replace the rectangles on a layer with their union, such that no two
+ * rectangles overlap and abutting rectangles are combined. Shapes and lines
+ * are left untouched.
+ */
+void
+phx_layer_merge(phx_layer_t *layer) {
+	assert(layer);
+	if (layer->rects.size < 2)
+		return;
+	phx_rects_t merged;
+	phx_rects_init(&merged);
+	phx_rects_merge(&layer->rects, &merged);
+	phx_rects_dispose(&layer->rects);
+	layer->rects = merged;
+	phx_layer_invalidate(layer, PHX_INDEX | PHX_FLAT);
+}
+
+
+/**
+ * Merge the rectangles on all layers of a geometry. Shared geometry is copied
+ * into the geometry first, such that it takes part in the merge. See
+ * phx_layer_merge.
+ */
+void
+phx_geometry_merge(phx_geometry_t *geo) {
+	assert(geo);
+	phx_geometry_materialize(geo);
+	for (unsigned u = 0; u < geo->layers.size; ++u)
+		phx_layer_merge(array_get(&geo->layers, u));
+}
@@ -267,6 +267,11 @@ phx_net_update_timing(phx_net_t *net) {
 void
 phx_net_update(phx_net_t *net, uint8_t bits) {
 	assert(net);
-	if (net->invalid & bits & PHX_TIMING)
+	if (net->invalid & bits & PHX_TIMING) {
+		phx_library_t *lib = net->cell->lib;
+		uint64_t start = lib->trace ? phx_trace_now() : 0;
 		phx_net_update_timing(net);
+		if (lib->trace)
+			phx_trace_update(lib, PHX_UPDATE_NET_TIMING, net->cell, start);
+	}
 }
@@ -0,0 +1,190 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#include "design-internal.h"
+
+/**
+ * @file
+ *
+ * This file implements axis-aligned rectangles and the list in which layers
+ * store them. The loops over the coordinate arrays are kept free of branches
+ * and dependencies between iterations, such that the compiler can vectorize
+ * them.
+ */
+
+
+/**
+ * Check whether a polygon is an axis-aligned rectangle, and if it is, store
+ * its bounds in @a out.
+ */
+bool
+phx_rect_from_points(size_t num_pts, vec2i_t *pts, phx_rect_t *out) {
+	assert(pts && out);
+	if (num_pts != 4)
+		return false;
+
+	bool is_rect = (
+		pts[0].x == pts[1].x && pts[1].y == pts[2].y &&
+		pts[2].x == pts[3].x && pts[3].y == pts[0].y
+	) || (
+		pts[0].y == pts[1].y && pts[1].x == pts[2].x &&
+		pts[2].y == pts[3].y && pts[3].x == pts[0].x
+	);
+	if (!is_rect)
+		return false;
+
+	out->min.x = pts[0].x < pts[2].x ? pts[0].x : pts[2].x;
+	out->min.y = pts[0].y < pts[2].y ? pts[0].y : pts[2].y;
+	out->max.x = pts[0].x > pts[2].x ? pts[0].x : pts[2].x;
+	out->max.y = pts[0].y > pts[2].y ? pts[0].y : pts[2].y;
+	return true;
+}
+
+
+/**
+ * Check whether two rectangles overlap or touch.
+ */
+bool
+phx_rect_overlaps(phx_rect_t a, phx_rect_t b) {
+	return a.min.x <= b.max.x && b.min.x <= a.max.x &&
+	       a.min.y <= b.max.y && b.min.y <= a.max.y;
+}
+
+
+void
+phx_rects_init(phx_rects_t *rects) {
+	assert(rects);
+	memset(rects, 0, sizeof(*rects));
+}
+
+
+void
+phx_rects_dispose(phx_rects_t *rects) {
+	assert(rects);
+	if (rects->xmin)
+		free(rects->xmin);
+	memset(rects, 0, sizeof(*rects));
+}
+
+
+/**
+ * Makes sure that the list can hold at least @a capacity rectangles without
+ * having to reallocate its memory.
+ */
+void
+phx_rects_reserve(phx_rects_t *rects, unsigned capacity) {
+	assert(rects);
+	if (capacity <= rects->capacity)
+		return;
+
+	int32_t *data = malloc(capacity * 4 * sizeof(int32_t));
+	if (rects->size > 0) {
+		size_t sz = rects->size * sizeof(int32_t);
+		memcpy(data + 0*capacity, rects->xmin, sz);
+		memcpy(data + 1*capacity, rects->ymin, sz);
+		memcpy(data + 2*capacity, rects->xmax, sz);
+		memcpy(data + 3*capacity, rects->ymax, sz);
+	}
+	if (rects->xmin)
+		free(rects->xmin);
+
+	rects->capacity = capacity;
+	rects->xmin = data + 0*capacity;
+	rects->ymin = data + 1*capacity;
+	rects->xmax = data + 2*capacity;
+	rects->ymax = data + 3*capacity;
+}
+
+
+void
+phx_rects_add(phx_rects_t *rects, phx_rect_t rect) {
+	assert(rects);
+	if (rects->size == rects->capacity)
+		phx_rects_reserve(rects, rects->capacity == 0 ? 4 : rects->capacity * 2);
+	unsigned idx = rects->size++;
+	rects->xmin[idx] = rect.min.x;
+	rects->ymin[idx] = rect.min.y;
+	rects->xmax[idx] = rect.max.x;
+	rects->ymax[idx] = rect.max.y;
+}
+
+
+phx_rect_t
+phx_rects_get(phx_rects_t *rects, unsigned idx) {
+	assert(rects && idx < rects->size);
+	return (phx_rect_t){
+		{ rects->xmin[idx], rects->ymin[idx] },
+		{ rects->xmax[idx], rects->ymax[idx] },
+	};
+}
+
+
+/**
+ * Removes all rectangles from the list.
+ */
+void
+phx_rects_clear(phx_rects_t *rects) {
+	assert(rects);
+	rects->size = 0;
+}
+
+
+/**
+ * Calculates the bounding box of all rectangles in the list.
+ *
+ * @return `false` if the list is empty, in which case @a out is not modified.
+ */
+bool
+phx_rects_get_bounds(phx_rects_t *rects, phx_rect_t *out) {
+	assert(rects && out);
+	if (rects->size == 0)
+		return false;
+
+	int32_t xmin = INT32_MAX, ymin = INT32_MAX, xmax = INT32_MIN, ymax = INT32_MIN;
+	unsigned n = rects->size;
+	for (unsigned u = 0; u < n; ++u)
+		xmin = rects->xmin[u] < xmin ? rects->xmin[u] : xmin;
+	for (unsigned u = 0; u < n; ++u)
+		ymin = rects->ymin[u] < ymin ? rects->ymin[u] : ymin;
+	for (unsigned u = 0; u < n; ++u)
+		xmax = rects->xmax[u] > xmax ? rects->xmax[u] : xmax;
+	for (unsigned u = 0; u < n; ++u)
+		ymax = rects->ymax[u] > ymax ? rects->ymax[u] : ymax;
+
+	*out = (phx_rect_t){ {xmin, ymin}, {xmax, ymax} };
+	return true;
+}
+
+
+/**
+ * Finds the rectangles in the list that overlap or touch @a box. The indices
+ * of the rectangles found are stored in @a out, which must be able to hold as
+ * many indices as there are rectangles in the list.
+ *
+ * @return The number of rectangles found.
+ */
+unsigned
+phx_rects_find_overlaps(phx_rects_t *rects, phx_rect_t box, uint32_t *out) {
+	assert(rects && out);
+	unsigned num_found = 0;
+	uint8_t hit[256];
+
+	// Process the rectangles in blocks. The overlap test of each block is
+	// vectorized, the compaction of the hits into the output is not.
+	for (unsigned base = 0; base < rects->size; base += sizeof(hit)) {
+		unsigned n = rects->size - base;
+		if (n > sizeof(hit))
+			n = sizeof(hit);
+		const int32_t *xmin = rects->xmin + base, *ymin = rects->ymin + base;
+		const int32_t *xmax = rects->xmax + base, *ymax = rects->ymax + base;
+
+		for (unsigned u = 0; u < n; ++u) {
+			hit[u] = (xmin[u] <= box.max.x) & (box.min.x <= xmax[u]) &
+			         (ymin[u] <= box.max.y) & (box.min.y <= ymax[u]);
+		}
+		for (unsigned u = 0; u < n; ++u) {
+			out[num_found] = base + u;
+			num_found += hit[u];
+		}
+	}
+
+	return num_found;
+}
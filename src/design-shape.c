@@ -0,0 +1,161 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#include "design-internal.h"
+
+/**
+ * @file
+ *
+ * This file implements the interning of shapes across a library. Libraries
+ * repeat the same contacts, vias, and rail segments many times over, at
+ * different positions. Each shape is therefore normalized by rotating its
+ * list of points to start at the lowest point and translating it such that
+ * this point lies at the origin. The normalized shape is looked up in a hash
+ * table keyed on the layer and the points, and only stored if it has not been
+ * seen before. Layers refer to the canonical shape together with an offset.
+ */
+
+
+typedef struct shape_entry {
+	uint32_t hash;
+	phx_tech_layer_t *tech;
+	phx_shape_t *shape;
+} shape_entry_t;
+
+struct phx_shape_table {
+	/// The number of shapes in the table.
+	unsigned size;
+	/// The number of slots in the table. Always a power of two.
+	unsigned capacity;
+	/// The slots, with empty ones having a `NULL` shape.
+	shape_entry_t *slots;
+	/// The memory the shapes are allocated from.
+	pool_t pool;
+};
+
+
+static uint32_t
+hash_shape(phx_tech_layer_t *tech, size_t num_pts, const vec2i_t *pts, size_t first) {
+	// FNV-1a over the layer, the number of points, and the normalized points.
+	uint32_t h = 2166136261u;
+	uintptr_t t = (uintptr_t)tech;
+	for (unsigned u = 0; u < sizeof(t); ++u, t >>= 8)
+		h = (h ^ (t & 0xFF)) * 16777619u;
+	h = (h ^ num_pts) * 16777619u;
+	for (size_t z = 0; z < num_pts; ++z) {
+		const vec2i_t *pt = pts + (first + z) % num_pts;
+		uint32_t x = pt->x - pts[first].x, y = pt->y - pts[first].y;
+		h = (h ^ x) * 16777619u;
+		h = (h ^ y) * 16777619u;
+	}
+	return h;
+}
+
+
+static bool
+equal_shape(shape_entry_t *entry, phx_tech_layer_t *tech, size_t num_pts, const vec2i_t *pts, size_t first) {
+	if (entry->tech != tech || entry->shape->num_pts != num_pts)
+		return false;
+	for (size_t z = 0; z < num_pts; ++z) {
+		const vec2i_t *pt = pts + (first + z) % num_pts;
+		if (entry->shape->pts[z].x != pt->x - pts[first].x ||
+		    entry->shape->pts[z].y != pt->y - pts[first].y)
+			return false;
+	}
+	return true;
+}
+
+
+static void
+grow_table(phx_shape_table_t *table) {
+	unsigned capacity = table->capacity ? table->capacity * 2 : 1024;
+	shape_entry_t *slots = calloc(capacity, sizeof(shape_entry_t));
+	for (unsigned u = 0; u < table->capacity; ++u) {
+		shape_entry_t *entry = table->slots + u;
+		if (!entry->shape)
+			continue;
+		unsigned i = entry->hash & (capacity - 1);
+		while (slots[i].shape)
+			i = (i + 1) & (capacity - 1);
+		slots[i] = *entry;
+	}
+	free(table->slots);
+	table->slots = slots;
+	table->capacity = capacity;
+}
+
+
+/**
+ * Find the canonical shape for a list of points on a layer, creating it if
+ * necessary.
+ *
+ * @param off  Receives the offset at which the canonical shape has to be
+ *             placed to cover the given points.
+ */
+phx_shape_t *
+phx_shape_table_intern(phx_shape_table_t *table, phx_tech_layer_t *tech, size_t num_pts, const vec2i_t *pts, vec2i_t *off) {
+	assert(table && tech && num_pts > 0 && pts && off);
+
+	// Start at the lowest point, and the leftmost one among those.
+	size_t first = 0;
+	for (size_t z = 1; z < num_pts; ++z)
+		if (pts[z].y < pts[first].y || (pts[z].y == pts[first].y && pts[z].x < pts[first].x))
+			first = z;
+	*off = pts[first];
+
+	// Keep the table at most half full.
+	if (2 * (table->size + 1) > table->capacity)
+		grow_table(table);
+
+	uint32_t hash = hash_shape(tech, num_pts, pts, first);
+	unsigned i = hash & (table->capacity - 1);
+	for (; table->slots[i].shape; i = (i + 1) & (table->capacity - 1)) {
+		shape_entry_t *entry = table->slots + i;
+		if (entry->hash == hash && equal_shape(entry, tech, num_pts, pts, first))
+			return entry->shape;
+	}
+
+	phx_shape_t *shape = pool_alloc(&table->pool, sizeof(*shape) + num_pts * sizeof(vec2i_t));
+	shape->num_pts = num_pts;
+	shape->interned = true;
+	for (size_t z = 0; z < num_pts; ++z) {
+		const vec2i_t *pt = pts + (first + z) % num_pts;
+		shape->pts[z] = (vec2i_t){ pt->x - off->x, pt->y - off->y };
+	}
+	table->slots[i] = (shape_entry_t){ hash, tech, shape };
+	++table->size;
+	return shape;
+}
+
+
+void
+phx_shape_table_destroy(phx_shape_table_t *table) {
+	assert(table);
+	free(table->slots);
+	pool_dispose(&table->pool);
+	free(table);
+}
+
+
+/**
+ * Get the number of bytes held by the interned shapes and their lookup table.
+ */
+size_t
+phx_shape_table_get_size(phx_shape_table_t *table) {
+	assert(table);
+	return sizeof(*table) + table->capacity * sizeof(shape_entry_t) + pool_get_size(&table->pool);
+}
+
+
+/**
+ * Intern the shapes subsequently added to the library's geometry. Identical
+ * shapes on the same layer are stored only once, regardless of their
+ * position, and can be compared by pointer. Shapes added before are not
+ * affected.
+ */
+void
+phx_library_intern_shapes(phx_library_t *lib) {
+	assert(lib);
+	if (lib->shapes)
+		return;
+	lib->shapes = calloc(1, sizeof(phx_shape_table_t));
+	pool_init(&lib->shapes->pool);
+}
@@ -0,0 +1,540 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#include "design-internal.h"
+#include "tech.h"
+
+/**
+ * @file
+ *
+ * This file implements a check of the technology's minimum width and spacing
+ * rules on a composed cell. The instantiated cells are assumed to be clean by
+ * themselves, such that only two kinds of geometry need to be checked: the
+ * geometry of an instance that lies close to the instance's boundary, where
+ * it may come close to a neighbouring instance, and the cell's own geometry,
+ * such as routes and pins. Geometry deep inside an instance is only
+ * considered if another instance overlaps it, or if the cell's own geometry
+ * comes close to it. Neighbours are found with spatial indices, such that the
+ * cost grows with the amount of geometry along instance boundaries rather
+ * than with the total amount of geometry.
+ */
+
+
+/// The geometry of an instantiated cell close to the cell's boundary, on the
+/// layer being checked.
+typedef struct spacing_master {
+	phx_cell_t *cell;
+	array_t boxes; /* phx_rect_t */
+} spacing_master_t;
+
+/// A layer of the cell's own geometry or of one of its pins, placed by
+/// @a xf, and the bounds of its geometry in the cell's coordinate space.
+typedef struct spacing_own {
+	phx_layer_t *layer;
+	phx_xform_t xf;
+	phx_rect_t box;
+} spacing_own_t;
+
+typedef struct spacing_check {
+	phx_cell_t *cell;
+	phx_tech_layer_t *tech;
+	/// The rules of the layer being checked, in database units.
+	int32_t min_width;
+	int32_t min_spacing;
+	/// The boundary geometry of each instantiated cell, sorted by cell.
+	array_t masters; /* spacing_master_t */
+	/// The geometry of the instances that is checked against other
+	/// instances, in the cell's coordinate space, and the index of the
+	/// instance each box belongs to.
+	array_t boxes; /* phx_rect_t */
+	array_t owners; /* uint32_t */
+	phx_index_t index;
+	/// The layers of the cell's own geometry and of its pins, and an index of
+	/// their bounds.
+	array_t own; /* spacing_own_t */
+	phx_index_t own_index;
+	/// The number of pieces of geometry on the layer.
+	size_t num_checked;
+	/// The flattened layers of an instantiated cell, reused across queries.
+	array_t flat; /* phx_flat_layer_t */
+	/// The violations found.
+	array_t *out; /* phx_spacing_violation_t */
+} spacing_check_t;
+
+
+static phx_rect_t
+expand_rect(phx_rect_t r, int32_t d) {
+	return (phx_rect_t){
+		{ r.min.x - d, r.min.y - d },
+		{ r.max.x + d, r.max.y + d },
+	};
+}
+
+
+static phx_rect_t
+inst_bounds(phx_inst_t *inst) {
+	phx_library_t *lib = inst->parent->lib;
+	return (phx_rect_t){
+		phx_library_vec_to_dbu(lib, inst->ext.min),
+		phx_library_vec_to_dbu(lib, inst->ext.max),
+	};
+}
+
+
+/**
+ * Check the distance between two pieces of geometry, and report a violation
+ * if they are closer than the minimum spacing. Geometry that overlaps or
+ * touches is considered connected and is not reported.
+ */
+static void
+check_pair(spacing_check_t *chk, phx_inst_t *inst_a, phx_rect_t a, phx_inst_t *inst_b, phx_rect_t b) {
+	int64_t dx = 0, dy = 0;
+	if (b.min.x > a.max.x)
+		dx = (int64_t)b.min.x - a.max.x;
+	else if (a.min.x > b.max.x)
+		dx = (int64_t)a.min.x - b.max.x;
+	if (b.min.y > a.max.y)
+		dy = (int64_t)b.min.y - a.max.y;
+	else if (a.min.y > b.max.y)
+		dy = (int64_t)a.min.y - b.max.y;
+	if (dx == 0 && dy == 0)
+		return;
+
+	int64_t s = chk->min_spacing, d2 = dx*dx + dy*dy;
+	if (d2 >= s*s)
+		return;
+	phx_spacing_violation_t v = { chk->tech, inst_a, inst_b, a, b, (int32_t)sqrt(d2), false };
+	array_add(chk->out, &v);
+}
+
+
+/**
+ * Check the width of a piece of the cell's own geometry. The width of lines
+ * is known exactly, the width of rectangles and shapes is taken to be the
+ * smaller side of their bounding box.
+ */
+static void
+check_width(spacing_check_t *chk, phx_layer_t *layer, phx_layer_item_t kind, size_t idx, phx_rect_t box) {
+	int32_t w;
+	if (kind == PHX_LAYER_LINE) {
+		w = phx_layer_get_line(layer, idx)->width;
+	} else {
+		int32_t dx = box.max.x - box.min.x, dy = box.max.y - box.min.y;
+		w = dx < dy ? dx : dy;
+	}
+	if (w >= chk->min_width)
+		return;
+	phx_spacing_violation_t v = { chk->tech, NULL, NULL, box, box, w, true };
+	array_add(chk->out, &v);
+}
+
+
+static int
+compare_masters(spacing_master_t *a, spacing_master_t *b) {
+	if (a->cell < b->cell) return -1;
+	if (a->cell > b->cell) return  1;
+	return 0;
+}
+
+
+static int
+compare_keys(const void *pa, const void *pb) {
+	uint64_t a = *(const uint64_t*)pa, b = *(const uint64_t*)pb;
+	return (a > b) - (a < b);
+}
+
+
+static void
+collect_item(void *arg, phx_layer_t *layer, phx_layer_item_t kind, size_t idx) {
+	uint64_t key = (uint64_t)kind << 32 | idx;
+	array_add(arg, &key);
+}
+
+
+/**
+ * Find the geometry of an instantiated cell that lies within the minimum
+ * spacing of the cell's boundary. Only this geometry can come too close to
+ * the geometry of a neighbouring instance that does not overlap the cell. The
+ * result is calculated once per cell and shared among all its instances.
+ */
+static spacing_master_t *
+find_master(spacing_check_t *chk, phx_cell_t *cell) {
+	spacing_master_t key = { .cell = cell };
+	unsigned pos;
+	spacing_master_t *master = array_bsearch(&chk->masters, &key, (void*)compare_masters, &pos);
+	if (master)
+		return master;
+	master = array_insert(&chk->masters, pos, NULL);
+	master->cell = cell;
+	array_init(&master->boxes, sizeof(phx_rect_t));
+
+	chk->flat.size = 0;
+	phx_cell_get_flat_layers(cell, chk->tech, &chk->flat);
+	if (chk->flat.size == 0)
+		return master;
+
+	// Query strips along the four edges of the cell's extents. Geometry near
+	// a corner is found twice.
+	phx_rect_t ext = {
+		phx_library_vec_to_dbu(cell->lib, cell->ext.min),
+		phx_library_vec_to_dbu(cell->lib, cell->ext.max),
+	};
+	int32_t s = chk->min_spacing;
+	phx_rect_t strips[] = {
+		{ ext.min, { ext.min.x + s, ext.max.y } },
+		{ { ext.max.x - s, ext.min.y }, ext.max },
+		{ ext.min, { ext.max.x, ext.min.y + s } },
+		{ { ext.min.x, ext.max.y - s }, ext.max },
+	};
+	array_t items;
+	array_init(&items, sizeof(uint64_t));
+	for (unsigned v = 0; v < chk->flat.size; ++v) {
+		phx_flat_layer_t *flat = array_get(&chk->flat, v);
+		phx_xform_t inv = phx_xform_invert(flat->xf);
+		items.size = 0;
+		for (unsigned u = 0; u < ASIZE(strips); ++u)
+			phx_layer_query(flat->layer, phx_xform_apply_rect(&inv, strips[u]), collect_item, &items);
+		qsort(items.items, items.size, items.item_size, compare_keys);
+
+		for (unsigned u = 0; u < items.size; ++u) {
+			uint64_t key = array_at(items, uint64_t, u);
+			if (u > 0 && key == array_at(items, uint64_t, u-1))
+				continue;
+			phx_rect_t box = phx_xform_apply_rect(&flat->xf, phx_layer_get_bounds(flat->layer, key >> 32, (uint32_t)key));
+			array_add(&master->boxes, &box);
+		}
+	}
+	array_dispose(&items);
+	return master;
+}
+
+
+struct overlap_ctx {
+	phx_cell_t *cell;
+	uint32_t self;
+	phx_rect_t box;
+	bool found;
+};
+
+
+static void
+overlap_hit(void *arg, uint32_t idx) {
+	struct overlap_ctx *ctx = arg;
+	if (idx == ctx->self)
+		return;
+	phx_rect_t b = inst_bounds(array_at(ctx->cell->insts, phx_inst_t*, idx));
+	phx_rect_t a = ctx->box;
+	if (a.min.x < b.max.x && b.min.x < a.max.x && a.min.y < b.max.y && b.min.y < a.max.y)
+		ctx->found = true;
+}
+
+
+static void
+add_inst_box(spacing_check_t *chk, uint32_t owner, phx_rect_t box) {
+	array_add(&chk->boxes, &box);
+	array_add(&chk->owners, &owner);
+}
+
+
+/**
+ * Add the geometry of an instance that needs to be checked against other
+ * instances. This is the geometry near the instance's boundary, or all of
+ * its geometry if another instance overlaps it.
+ */
+static void
+add_inst(spacing_check_t *chk, uint32_t idx) {
+	phx_inst_t *inst = array_at(chk->cell->insts, phx_inst_t*, idx);
+	struct overlap_ctx ctx = { chk->cell, idx, inst_bounds(inst), false };
+	phx_cell_query_insts(chk->cell, ctx.box, overlap_hit, &ctx);
+
+	if (!ctx.found) {
+		spacing_master_t *master = find_master(chk, inst->cell);
+		for (unsigned u = 0; u < master->boxes.size; ++u)
+			add_inst_box(chk, idx, phx_xform_apply_rect(&inst->xform, array_at(master->boxes, phx_rect_t, u)));
+		return;
+	}
+
+	chk->flat.size = 0;
+	phx_cell_get_flat_layers(inst->cell, chk->tech, &chk->flat);
+	for (unsigned u = 0; u < chk->flat.size; ++u) {
+		phx_flat_layer_t *flat = array_get(&chk->flat, u);
+		phx_layer_t *layer = flat->layer;
+		phx_xform_t xf = phx_xform_mul(inst->xform, flat->xf);
+		phx_layer_item_t kinds[] = { PHX_LAYER_RECT, PHX_LAYER_SHAPE, PHX_LAYER_LINE };
+		size_t counts[] = { layer->rects.size, layer->shapes.size, layer->lines.size };
+		for (unsigned k = 0; k < ASIZE(kinds); ++k)
+			for (size_t z = 0; z < counts[k]; ++z)
+				add_inst_box(chk, idx, phx_xform_apply_rect(&xf, phx_layer_get_bounds(layer, kinds[k], z)));
+	}
+}
+
+
+struct inst_pair_ctx {
+	spacing_check_t *chk;
+	uint32_t idx;
+};
+
+
+static void
+inst_pair_hit(void *arg, uint32_t idx) {
+	struct inst_pair_ctx *ctx = arg;
+	spacing_check_t *chk = ctx->chk;
+	uint32_t owner_a = array_at(chk->owners, uint32_t, ctx->idx);
+	uint32_t owner_b = array_at(chk->owners, uint32_t, idx);
+	// Skip geometry of the same instance, and report each pair only once.
+	if (owner_a >= owner_b)
+		return;
+	check_pair(chk,
+		array_at(chk->cell->insts, phx_inst_t*, owner_a), array_at(chk->boxes, phx_rect_t, ctx->idx),
+		array_at(chk->cell->insts, phx_inst_t*, owner_b), array_at(chk->boxes, phx_rect_t, idx));
+}
+
+
+struct route_ctx {
+	spacing_check_t *chk;
+	/// The piece of the cell's own geometry being checked, and the own layer
+	/// it is checked against.
+	unsigned own;
+	unsigned other;
+	phx_layer_item_t kind;
+	size_t idx;
+	phx_rect_t box;
+	/// The instance whose geometry is being searched, and the transformation
+	/// of the layer being searched into the cell.
+	phx_inst_t *inst;
+	phx_xform_t xf;
+};
+
+
+static void
+route_route_hit(void *arg, phx_layer_t *layer, phx_layer_item_t kind, size_t idx) {
+	struct route_ctx *ctx = arg;
+	// Report each pair only once.
+	if (ctx->other == ctx->own && (kind < ctx->kind || (kind == ctx->kind && idx <= ctx->idx)))
+		return;
+	spacing_own_t *other = array_get(&ctx->chk->own, ctx->other);
+	check_pair(ctx->chk, NULL, ctx->box, NULL, phx_xform_apply_rect(&other->xf, phx_layer_get_bounds(layer, kind, idx)));
+}
+
+
+static void
+route_own_hit(void *arg, uint32_t idx) {
+	struct route_ctx *ctx = arg;
+	// Pairs with earlier own layers have been checked already.
+	if (idx < ctx->own)
+		return;
+	ctx->other = idx;
+	spacing_own_t *other = array_get(&ctx->chk->own, idx);
+	phx_xform_t inv = phx_xform_invert(other->xf);
+	phx_rect_t near = phx_xform_apply_rect(&inv, expand_rect(ctx->box, ctx->chk->min_spacing));
+	phx_layer_query(other->layer, near, route_route_hit, ctx);
+}
+
+
+static void
+route_geometry_hit(void *arg, phx_layer_t *layer, phx_layer_item_t kind, size_t idx) {
+	struct route_ctx *ctx = arg;
+	phx_rect_t box = phx_xform_apply_rect(&ctx->xf, phx_layer_get_bounds(layer, kind, idx));
+	check_pair(ctx->chk, NULL, ctx->box, ctx->inst, box);
+}
+
+
+static void
+route_inst_hit(void *arg, uint32_t idx) {
+	struct route_ctx *ctx = arg;
+	spacing_check_t *chk = ctx->chk;
+	ctx->inst = array_at(chk->cell->insts, phx_inst_t*, idx);
+	chk->flat.size = 0;
+	phx_cell_get_flat_layers(ctx->inst->cell, chk->tech, &chk->flat);
+	for (unsigned u = 0; u < chk->flat.size; ++u) {
+		phx_flat_layer_t *flat = array_get(&chk->flat, u);
+		ctx->xf = phx_xform_mul(ctx->inst->xform, flat->xf);
+		phx_xform_t inv = phx_xform_invert(ctx->xf);
+		phx_rect_t near = phx_xform_apply_rect(&inv, expand_rect(ctx->box, chk->min_spacing));
+		phx_layer_query(flat->layer, near, route_geometry_hit, ctx);
+	}
+}
+
+
+static void
+add_own_layer(spacing_check_t *chk, phx_layer_t *layer, phx_xform_t xf) {
+	if (!layer)
+		return;
+	spacing_own_t own = { layer, xf, { { 0, 0 }, { 0, 0 } } };
+	phx_layer_item_t kinds[] = { PHX_LAYER_RECT, PHX_LAYER_SHAPE, PHX_LAYER_LINE };
+	size_t counts[] = { layer->rects.size, layer->shapes.size, layer->lines.size };
+	bool any = false;
+	for (unsigned k = 0; k < ASIZE(kinds); ++k) {
+		for (size_t z = 0; z < counts[k]; ++z) {
+			phx_rect_t r = phx_xform_apply_rect(&xf, phx_layer_get_bounds(layer, kinds[k], z));
+			if (!any) {
+				own.box = r;
+				any = true;
+				continue;
+			}
+			if (r.min.x < own.box.min.x) own.box.min.x = r.min.x;
+			if (r.min.y < own.box.min.y) own.box.min.y = r.min.y;
+			if (r.max.x > own.box.max.x) own.box.max.x = r.max.x;
+			if (r.max.y > own.box.max.y) own.box.max.y = r.max.y;
+		}
+	}
+	if (any)
+		array_add(&chk->own, &own);
+}
+
+
+/**
+ * Add the layers of a geometry of the cell to the geometry to be checked.
+ * As in the flattened geometry, shared blocks are only followed if they were
+ * created from geometry of the cell itself. Blocks raised from the cell's
+ * instances are covered by the instances.
+ */
+static void
+add_own(spacing_check_t *chk, phx_geometry_t *geo) {
+	add_own_layer(chk, phx_geometry_find_layer(geo, chk->tech), phx_xform_identity());
+	for (unsigned u = 0; u < geo->refs.size; ++u) {
+		phx_geometry_ref_t *ref = array_get(&geo->refs, u);
+		if (ref->block->geo.cell == chk->cell)
+			add_own_layer(chk, phx_geometry_find_layer(&ref->block->geo, chk->tech), ref->xf);
+	}
+}
+
+
+static void
+check_layer(spacing_check_t *chk) {
+	phx_cell_t *cell = chk->cell;
+	int32_t s = chk->min_spacing;
+
+	for (unsigned u = 0; u < cell->insts.size; ++u) {
+		phx_inst_t *inst = array_at(cell->insts, phx_inst_t*, u);
+		chk->flat.size = 0;
+		phx_cell_get_flat_layers(inst->cell, chk->tech, &chk->flat);
+		for (unsigned v = 0; v < chk->flat.size; ++v) {
+			phx_layer_t *layer = array_at(chk->flat, phx_flat_layer_t, v).layer;
+			chk->num_checked += layer->rects.size + layer->shapes.size + layer->lines.size;
+		}
+	}
+
+	// Check the geometry along the instance boundaries against the
+	// geometry of neighbouring instances.
+	if (s > 0 && cell->insts.size > 1) {
+		for (unsigned u = 0; u < cell->insts.size; ++u)
+			add_inst(chk, u);
+		unsigned num = chk->boxes.size;
+		uint32_t *ids = malloc(num * sizeof(uint32_t));
+		for (unsigned u = 0; u < num; ++u)
+			ids[u] = u;
+		phx_index_build(&chk->index, num, chk->boxes.items, ids);
+		free(ids);
+
+		struct inst_pair_ctx ctx = { chk, 0 };
+		for (ctx.idx = 0; ctx.idx < num; ++ctx.idx)
+			phx_index_query(&chk->index, expand_rect(array_at(chk->boxes, phx_rect_t, ctx.idx), s), inst_pair_hit, &ctx);
+	}
+
+	// Check the cell's own geometry and the geometry of its pins against
+	// itself and against all geometry of the instances it comes close to.
+	add_own(chk, &cell->geo);
+	for (unsigned u = 0; u < cell->pins.size; ++u)
+		add_own(chk, &array_at(cell->pins, phx_pin_t*, u)->geo);
+	unsigned num = chk->own.size;
+	phx_rect_t *boxes = malloc(num * sizeof(phx_rect_t));
+	uint32_t *ids = malloc(num * sizeof(uint32_t));
+	for (unsigned u = 0; u < num; ++u) {
+		boxes[u] = array_at(chk->own, spacing_own_t, u).box;
+		ids[u] = u;
+	}
+	phx_index_build(&chk->own_index, num, boxes, ids);
+	free(boxes);
+	free(ids);
+
+	struct route_ctx ctx = { .chk = chk };
+	for (ctx.own = 0; ctx.own < num; ++ctx.own) {
+		spacing_own_t *own = array_get(&chk->own, ctx.own);
+		phx_layer_t *layer = own->layer;
+		phx_layer_item_t kinds[] = { PHX_LAYER_RECT, PHX_LAYER_SHAPE, PHX_LAYER_LINE };
+		size_t counts[] = { layer->rects.size, layer->shapes.size, layer->lines.size };
+		for (unsigned k = 0; k < ASIZE(kinds); ++k) {
+			chk->num_checked += counts[k];
+			for (size_t z = 0; z < counts[k]; ++z) {
+				ctx.kind = kinds[k];
+				ctx.idx = z;
+				ctx.box = phx_xform_apply_rect(&own->xf, phx_layer_get_bounds(layer, kinds[k], z));
+				if (chk->min_width > 0)
+					check_width(chk, layer, kinds[k], z, ctx.box);
+				if (s == 0)
+					continue;
+				phx_rect_t near = expand_rect(ctx.box, s);
+				phx_index_query(&chk->own_index, near, route_own_hit, &ctx);
+				phx_cell_query_insts(cell, near, route_inst_hit, &ctx);
+			}
+		}
+	}
+}
+
+
+/**
+ * Check a cell against the minimum width and spacing rules of the technology
+ * layers. The instantiated cells are assumed to satisfy the rules by
+ * themselves. Checked are the width of the cell's own geometry and of its
+ * pins, its distance to all other geometry, and the distance between the
+ * geometry of different instances, including their pins. Bounding boxes are
+ * used for shapes and lines.
+ *
+ * @param out          Array of phx_spacing_violation_t that receives the
+ *                     violations.
+ * @param num_checked  If not `NULL`, receives the number of pieces of
+ *                     geometry on layers with rules, counting the geometry of
+ *                     each instance. Zero means that nothing was checked.
+ *
+ * @return The number of violations found.
+ */
+unsigned
+phx_cell_check_spacing(phx_cell_t *cell, array_t *out, size_t *num_checked) {
+	assert(cell && out && out->item_size == sizeof(phx_spacing_violation_t));
+	unsigned base = out->size;
+	size_t checked = 0;
+
+	// Bring the extents and the flattened geometry of the instantiated cells
+	// up to date, such that the queries below do not modify the cell.
+	phx_cell_update(cell, PHX_EXTENTS);
+	for (unsigned u = 0; u < cell->insts.size; ++u)
+		phx_cell_update(array_at(cell->insts, phx_inst_t*, u)->cell, PHX_FLAT);
+
+	phx_tech_t *tech = cell->lib->tech;
+	for (size_t z = 0; z < tech->layers.size; ++z) {
+		phx_tech_layer_t *tl = tech->layers.items[z];
+		if (tl->min_width <= 0 && tl->min_spacing <= 0)
+			continue;
+
+		spacing_check_t chk = {
+			.cell = cell,
+			.tech = tl,
+			.min_width = phx_library_to_dbu(cell->lib, tl->min_width),
+			.min_spacing = phx_library_to_dbu(cell->lib, tl->min_spacing),
+			.out = out,
+		};
+		array_init(&chk.masters, sizeof(spacing_master_t));
+		array_init(&chk.boxes, sizeof(phx_rect_t));
+		array_init(&chk.owners, sizeof(uint32_t));
+		phx_index_init(&chk.index);
+		array_init(&chk.own, sizeof(spacing_own_t));
+		array_init(&chk.flat, sizeof(phx_flat_layer_t));
+		phx_index_init(&chk.own_index);
+
+		check_layer(&chk);
+		checked += chk.num_checked;
+
+		for (unsigned u = 0; u < chk.masters.size; ++u)
+			array_dispose(&array_at(chk.masters, spacing_master_t, u).boxes);
+		array_dispose(&chk.masters);
+		array_dispose(&chk.boxes);
+		array_dispose(&chk.owners);
+		phx_index_dispose(&chk.index);
+		array_dispose(&chk.own);
+		array_dispose(&chk.flat);
+		phx_index_dispose(&chk.own_index);
+	}
+
+	if (num_checked)
+		*num_checked = checked;
+	return out->size - base;
+}
@@ -0,0 +1,173 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#define _POSIX_C_SOURCE 200112L
+#include "design-internal.h"
+#include <pthread.h>
+#include <time.h>
+
+/**
+ * @file
+ * @author Fabian Schuiki <fschuiki@student.ethz.ch>
+ *
+ * This file implements the tracing of updates. While a library is traced,
+ * every update of a cell is counted and timed, and every request for bits
+ * that are valid already is counted as a hit. Tracing costs a single check
+ * per update while it is off.
+ */
+
+
+static const char *kind_names[PHX_NUM_UPDATE_KINDS] = {
+	[PHX_UPDATE_EXTENTS]      = "extents",
+	[PHX_UPDATE_CAPACITANCES] = "capacitances",
+	[PHX_UPDATE_TIMING]       = "timing",
+	[PHX_UPDATE_LEAKAGE]      = "leakage",
+	[PHX_UPDATE_FLAT]         = "flat",
+	[PHX_UPDATE_NET_TIMING]   = "net_timing",
+	[PHX_UPDATE_INST_INDEX]   = "inst_index",
+};
+
+
+const char *
+phx_update_kind_name(phx_update_kind_t kind) {
+	assert(kind < PHX_NUM_UPDATE_KINDS);
+	return kind_names[kind];
+}
+
+
+/**
+ * @return A monotonic timestamp, in nanoseconds.
+ */
+uint64_t
+phx_trace_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Get the counters of a cell, creating them upon the first call. The counters
+ * are published with release semantics, such that threads that find them
+ * without taking the lock see them initialized.
+ */
+static phx_trace_cell_t *
+trace_cell(phx_trace_t *trace, phx_cell_t *cell) {
+	phx_trace_cell_t *tc = __atomic_load_n(&cell->trace, __ATOMIC_ACQUIRE);
+	if (tc)
+		return tc;
+	pthread_mutex_lock(&trace->lock);
+	tc = cell->trace;
+	if (!tc) {
+		tc = calloc(1, sizeof(*tc));
+		tc->cell = cell;
+		array_add(&trace->cells, &tc);
+		__atomic_store_n(&cell->trace, tc, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&trace->lock);
+	return tc;
+}
+
+
+/**
+ * Get the number of the calling thread. The trace must be locked.
+ */
+static unsigned
+trace_thread(phx_trace_t *trace) {
+	pthread_t self = pthread_self();
+	for (unsigned u = 0; u < trace->threads.size; ++u)
+		if (pthread_equal(array_at(trace->threads, pthread_t, u), self))
+			return u;
+	array_add(&trace->threads, &self);
+	return trace->threads.size - 1;
+}
+
+
+/**
+ * Record an update of a cell that started at a given time, as returned by
+ * phx_trace_now. The library must be traced.
+ */
+void
+phx_trace_update(phx_library_t *lib, phx_update_kind_t kind, phx_cell_t *cell, uint64_t start) {
+	assert(lib && lib->trace && kind < PHX_NUM_UPDATE_KINDS && cell);
+	phx_trace_t *trace = lib->trace;
+	uint64_t duration = phx_trace_now() - start;
+
+	__sync_fetch_and_add(&trace->counters[kind].calls, 1);
+	__sync_fetch_and_add(&trace->counters[kind].time_ns, duration);
+	phx_trace_cell_t *tc = trace_cell(trace, cell);
+	__sync_fetch_and_add(&tc->counters[kind].calls, 1);
+	__sync_fetch_and_add(&tc->counters[kind].time_ns, duration);
+
+	pthread_mutex_lock(&trace->lock);
+	phx_trace_event_t *event = array_add(&trace->events, NULL);
+	event->cell = cell;
+	event->kind = kind;
+	event->thread = trace_thread(trace);
+	event->start_ns = start - trace->start_ns;
+	event->duration_ns = duration;
+	pthread_mutex_unlock(&trace->lock);
+}
+
+
+/**
+ * Record a request for bits of a cell that were valid already. The library
+ * must be traced.
+ */
+void
+phx_trace_hit(phx_library_t *lib, phx_update_kind_t kind, phx_cell_t *cell) {
+	assert(lib && lib->trace && kind < PHX_NUM_UPDATE_KINDS && cell);
+	phx_trace_t *trace = lib->trace;
+	__sync_fetch_and_add(&trace->counters[kind].hits, 1);
+	__sync_fetch_and_add(&trace_cell(trace, cell)->counters[kind].hits, 1);
+}
+
+
+/**
+ * Start recording the updates of a library's cells. Any previous trace is
+ * discarded.
+ */
+void
+phx_library_start_trace(phx_library_t *lib) {
+	assert(lib);
+	phx_library_stop_trace(lib);
+	phx_trace_t *trace = calloc(1, sizeof(*trace));
+	array_init(&trace->cells, sizeof(phx_trace_cell_t*));
+	array_init(&trace->events, sizeof(phx_trace_event_t));
+	array_init(&trace->threads, sizeof(pthread_t));
+	pthread_mutex_init(&trace->lock, NULL);
+	trace->start_ns = phx_trace_now();
+	lib->trace = trace;
+}
+
+
+/**
+ * Stop recording the updates of a library's cells and discard the trace.
+ */
+void
+phx_library_stop_trace(phx_library_t *lib) {
+	assert(lib);
+	phx_trace_t *trace = lib->trace;
+	if (!trace)
+		return;
+	for (unsigned u = 0; u < trace->cells.size; ++u) {
+		phx_trace_cell_t *tc = array_at(trace->cells, phx_trace_cell_t*, u);
+		tc->cell->trace = NULL;
+		free(tc);
+	}
+	array_dispose(&trace->cells);
+	array_dispose(&trace->events);
+	array_dispose(&trace->threads);
+	pthread_mutex_destroy(&trace->lock);
+	free(trace);
+	lib->trace = NULL;
+}
+
+
+/**
+ * @return The updates recorded so far, or `NULL` if the library is not
+ *         traced.
+ */
+phx_trace_t *
+phx_library_get_trace(phx_library_t *lib) {
+	assert(lib);
+	return lib->trace;
+}
@@ -0,0 +1,162 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#include "design-internal.h"
+
+/**
+ * @file
+ *
+ * This file implements transformations between the coordinate spaces of
+ * instances and their parents. Since instances can only be mirrored and
+ * rotated by multiples of 90 degrees, the transformations are exact in
+ * database units and can be composed without accumulating rounding errors.
+ */
+
+
+phx_xform_t
+phx_xform_identity(void) {
+	return (phx_xform_t){ 1, 0, 0, 1, { 0, 0 } };
+}
+
+
+/**
+ * Create the transformation that maps a point from an instance with the given
+ * orientation to its parent. Equivalent to phx_inst_vec_to_parent, with the
+ * cell origin and instance position combined into @a off.
+ */
+phx_xform_t
+phx_xform_from_orientation(phx_orientation_t orientation, vec2i_t off) {
+	int32_t sx = (orientation & PHX_MIRROR_X) ? -1 : 1;
+	int32_t sy = (orientation & PHX_MIRROR_Y) ? -1 : 1;
+	if (orientation & PHX_ROTATE_90)
+		return (phx_xform_t){ 0, sy, -sx, 0, off };
+	else
+		return (phx_xform_t){ sx, 0, 0, sy, off };
+}
+
+
+/**
+ * Compose two transformations. The result maps a point first through @a b,
+ * then through @a a.
+ */
+phx_xform_t
+phx_xform_mul(phx_xform_t a, phx_xform_t b) {
+	return (phx_xform_t){
+		a.xx*b.xx + a.xy*b.yx, a.xx*b.xy + a.xy*b.yy,
+		a.yx*b.xx + a.yy*b.yx, a.yx*b.xy + a.yy*b.yy,
+		phx_xform_apply(&a, b.off),
+	};
+}
+
+
+/**
+ * Invert a transformation. Since the matrix is orthogonal, its inverse is its
+ * transpose.
+ */
+phx_xform_t
+phx_xform_invert(phx_xform_t x) {
+	return (phx_xform_t){
+		x.xx, x.yx,
+		x.xy, x.yy,
+		{
+			-(x.xx*x.off.x + x.yx*x.off.y),
+			-(x.xy*x.off.x + x.yy*x.off.y),
+		},
+	};
+}
+
+
+vec2i_t
+phx_xform_apply(phx_xform_t *x, vec2i_t pt) {
+	assert(x);
+	return (vec2i_t){
+		x->xx*pt.x + x->xy*pt.y + x->off.x,
+		x->yx*pt.x + x->yy*pt.y + x->off.y,
+	};
+}
+
+
+/**
+ * Transform a rectangle. The corners of the result are reordered such that
+ * `min` is again the lower left corner.
+ */
+phx_rect_t
+phx_xform_apply_rect(phx_xform_t *x, phx_rect_t r) {
+	assert(x);
+	vec2i_t a = phx_xform_apply(x, r.min);
+	vec2i_t b = phx_xform_apply(x, r.max);
+	return (phx_rect_t){
+		{ a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y },
+		{ a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y },
+	};
+}
+
+
+/**
+ * Transform a point given in meters. The offset of the transformation is
+ * scaled by @a dbu, the size of a database unit in meters.
+ */
+vec2_t
+phx_xform_apply_vec(phx_xform_t *x, vec2_t pt, double dbu) {
+	assert(x);
+	return (vec2_t){
+		x->xx*pt.x + x->xy*pt.y + x->off.x*dbu,
+		x->yx*pt.x + x->yy*pt.y + x->off.y*dbu,
+	};
+}
+
+
+/**
+ * Transform an array of points. The loop is free of branches, such that the
+ * compiler can vectorize it. @a src and @a dst may be the same array.
+ */
+void
+phx_xform_apply_many(phx_xform_t *x, size_t num_pts, const vec2i_t *src, vec2i_t *dst) {
+	assert(x && (num_pts == 0 || (src && dst)));
+	const int32_t xx = x->xx, xy = x->xy, yx = x->yx, yy = x->yy;
+	const int32_t ox = x->off.x, oy = x->off.y;
+	for (size_t z = 0; z < num_pts; ++z) {
+		int32_t px = src[z].x, py = src[z].y;
+		dst[z].x = xx*px + xy*py + ox;
+		dst[z].y = yx*px + yy*py + oy;
+	}
+}
+
+
+/**
+ * Transform all rectangles in @a src and append them to @a dst. Each
+ * coordinate array is processed in a separate branch-free loop, such that the
+ * compiler can vectorize them.
+ */
+void
+phx_xform_apply_rects(phx_xform_t *x, phx_rects_t *src, phx_rects_t *dst) {
+	assert(x && src && dst && src != dst);
+	unsigned n = src->size;
+	if (n == 0)
+		return;
+	if (dst->size + n > dst->capacity) {
+		unsigned grown = dst->capacity * 2;
+		phx_rects_reserve(dst, dst->size + n > grown ? dst->size + n : grown);
+	}
+
+	const int32_t *sxmin = src->xmin, *symin = src->ymin;
+	const int32_t *sxmax = src->xmax, *symax = src->ymax;
+	int32_t *dxmin = dst->xmin + dst->size, *dymin = dst->ymin + dst->size;
+	int32_t *dxmax = dst->xmax + dst->size, *dymax = dst->ymax + dst->size;
+
+	const int32_t xx = x->xx, xy = x->xy, ox = x->off.x;
+	for (unsigned u = 0; u < n; ++u) {
+		int32_t a = xx*sxmin[u] + xy*symin[u];
+		int32_t b = xx*sxmax[u] + xy*symax[u];
+		dxmin[u] = (a < b ? a : b) + ox;
+		dxmax[u] = (a > b ? a : b) + ox;
+	}
+
+	const int32_t yx = x->yx, yy = x->yy, oy = x->off.y;
+	for (unsigned u = 0; u < n; ++u) {
+		int32_t a = yx*sxmin[u] + yy*symin[u];
+		int32_t b = yx*sxmax[u] + yy*symax[u];
+		dymin[u] = (a < b ? a : b) + oy;
+		dymax[u] = (a > b ? a : b) + oy;
+	}
+
+	dst->size += n;
+}
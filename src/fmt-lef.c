@@ -13,9 +13,13 @@
  */
 
 
+/**
+ * Convert a geometry to LEF, including the shared geometry it references.
+ * All coordinates are transformed by @a xf.
+ */
 static void
-make_lef_geo(phx_geometry_t *geo, void (*commit)(void*, lef_geo_t*), void *arg) {
-	assert(geo && commit);
+make_lef_geo(phx_library_t *lib, phx_geometry_t *geo, phx_xform_t *xf, void (*commit)(void*, lef_geo_t*), void *arg) {
+	assert(lib && geo && xf && commit);
 
 	for (unsigned u = 0, un = phx_geometry_get_num_layers(geo); u < un; ++u) {
 		phx_layer_t *layer = phx_geometry_get_layer(geo, u);
@@ -35,31 +39,34 @@ make_lef_geo(phx_geometry_t *geo, void (*commit)(void*, lef_geo_t*), void *arg)
 		lef_geo_layer_t *dst_layer = lef_new_geo_layer(layer_name);
 		for (unsigned u = 0, un = phx_layer_get_num_shapes(layer); u < un; ++u) {
 			phx_shape_t *shape = phx_layer_get_shape(layer, u);
-
-			bool is_rect = false;
-			if (shape->num_pts == 4) {
-				unsigned i = (shape->pts[0].x != shape->pts[1].x ? 1 : 0);
-				is_rect = (
-					fabs(shape->pts[(i+0)%4].x - shape->pts[(i+1)%4].x) < 1e-10 &&
-					fabs(shape->pts[(i+1)%4].y - shape->pts[(i+2)%4].y) < 1e-10 &&
-					fabs(shape->pts[(i+2)%4].x - shape->pts[(i+3)%4].x) < 1e-10 &&
-					fabs(shape->pts[(i+3)%4].y - shape->pts[(i+4)%4].y) < 1e-10
-				);
+			vec2i_t off = phx_layer_get_shape_offset(layer, u);
+			lef_xy_t pts[shape->num_pts];
+			for (unsigned i = 0; i < shape->num_pts; ++i) {
+				vec2i_t pt = { shape->pts[i].x + off.x, shape->pts[i].y + off.y };
+				vec2_t v = phx_library_vec_from_dbu(lib, phx_xform_apply(xf, pt));
+				pts[i] = (lef_xy_t){ v.x, v.y };
 			}
+			lef_geo_layer_add_shape(dst_layer, lef_new_geo_shape(LEF_SHAPE_POLYGON, shape->num_pts, pts));
+		}
 
-			lef_geo_shape_t *dst_shape;
-			if (is_rect) {
-				dst_shape = lef_new_geo_shape(LEF_SHAPE_RECT, 2, (lef_xy_t[]){
-					{ shape->pts[0].x, shape->pts[0].y },
-					{ shape->pts[2].x, shape->pts[2].y },
-				});
-			} else {
-				dst_shape = lef_new_geo_shape(LEF_SHAPE_POLYGON, shape->num_pts, (void*)shape->pts);
-			}
-			lef_geo_layer_add_shape(dst_layer, dst_shape);
+		// Rectangles
+		for (unsigned u = 0, un = phx_layer_get_num_rects(layer); u < un; ++u) {
+			phx_rect_t rect = phx_xform_apply_rect(xf, phx_layer_get_rect(layer, u));
+			vec2_t a = phx_library_vec_from_dbu(lib, rect.min);
+			vec2_t b = phx_library_vec_from_dbu(lib, rect.max);
+			lef_geo_layer_add_shape(dst_layer, lef_new_geo_shape(LEF_SHAPE_RECT, 2, (lef_xy_t[]){
+				{ a.x, a.y },
+				{ b.x, b.y },
+			}));
 		}
 		commit(arg, (lef_geo_t*)dst_layer);
 	}
+
+	for (unsigned u = 0, un = phx_geometry_get_num_refs(geo); u < un; ++u) {
+		phx_geometry_ref_t *ref = phx_geometry_get_ref(geo, u);
+		phx_xform_t sub = phx_xform_mul(*xf, ref->xf);
+		make_lef_geo(lib, &ref->block->geo, &sub, commit, arg);
+	}
 }
 
 
@@ -78,7 +85,8 @@ phx_make_lef_macro_from_cell(phx_cell_t *cell) {
 		phx_pin_t *src_pin = phx_cell_get_pin(cell, u);
 		lef_pin_t *dst_pin = lef_new_pin(phx_pin_get_name(src_pin));
 		lef_port_t *port = lef_new_port();
-		make_lef_geo(phx_pin_get_geometry(src_pin), (void*)lef_port_add_geometry, port);
+		phx_xform_t identity = phx_xform_identity();
+		make_lef_geo(cell->lib, phx_pin_get_geometry(src_pin), &identity, (void*)lef_port_add_geometry, port);
 		lef_pin_add_port(dst_pin, port);
 		lef_macro_add_pin(macro, dst_pin);
 	}
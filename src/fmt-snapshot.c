@@ -0,0 +1,975 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#define _POSIX_C_SOURCE 200112L
+#include "design-internal.h"
+#include "table.h"
+#include "tech.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/**
+ * @file
+ *
+ * This file implements binary snapshots of an entire library, such that a
+ * script can restore the result of loading many LEF, LIB, and GDS files in a
+ * fraction of the time.
+ *
+ * A snapshot is a flat sequence of 32 bit integers, 64 bit floats, strings,
+ * and arrays in host byte order, with every item aligned to 8 bytes. Objects
+ * refer to each other by their position in the snapshot rather than by
+ * address, which makes the image relocatable. Loading maps the file into
+ * memory and rebuilds the library from it, copying the bulk of the geometry
+ * straight out of the mapping. The snapshot contains the technology, and for
+ * each cell its pins, geometry, instances, nets, timing arcs and their tables,
+ * and GDS text elements. Quantities derived by phx_cell_update are not stored
+ * and are recalculated after loading. The GDS structures cells carry for
+ * pass-through export are not stored either.
+ *
+ * The sections of a snapshot are, in order:
+ *
+ * - header: magic, version, byte order mark
+ * - technology: layers and vias
+ * - library: database unit, whether shapes are interned
+ * - cells: name, pin names and capacitances
+ * - tables: all timing tables, shared tables stored once
+ * - shapes: all interned shapes
+ * - blocks: all shared geometry blocks
+ * - cell contents: geometry, pins, instances, nets, timing arcs, GDS text
+ */
+
+
+#define SNAPSHOT_MAGIC "PHXSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BOM 0x01020304u
+#define SNAPSHOT_ALIGN 8
+#define SNAPSHOT_NONE 0xFFFFFFFFu
+
+enum snapshot_table_kind {
+	/// A scalar table with a single value.
+	SNAPSHOT_TABLE_SCALAR = 0,
+	/// A table created by phx_table_new, with its own list of axes.
+	SNAPSHOT_TABLE_AXES = 1,
+	/// A table created by phx_table_create_with_format.
+	SNAPSHOT_TABLE_FORMAT = 2,
+};
+
+enum snapshot_shape_kind {
+	SNAPSHOT_SHAPE_INLINE = 0,
+	SNAPSHOT_SHAPE_INTERNED = 1,
+};
+
+
+typedef struct writer {
+	FILE *out;
+	phx_library_t *lib;
+	/// The objects that are referred to by their position in these sets, in
+	/// addition to the technology's layers.
+	ptrset_t tables;
+	ptrset_t shapes;
+	ptrset_t blocks;
+} writer_t;
+
+typedef struct reader {
+	const char *base;
+	const char *ptr;
+	const char *end;
+	/// Set as soon as the snapshot turns out to be truncated or malformed.
+	bool failed;
+	phx_library_t *lib;
+	/// The objects created so far, indexed by their position in the snapshot.
+	array_t layers; /* phx_tech_layer_t* */
+	array_t cells; /* phx_cell_t* */
+	array_t tables; /* phx_table_t* */
+	array_t shapes; /* snapshot_shape_t */
+	array_t blocks; /* phx_geometry_t* */
+} reader_t;
+
+/**
+ * An interned shape read from a snapshot. The shape is only interned upon its
+ * first use, since the library's table of shapes is keyed on the layer.
+ */
+typedef struct snapshot_shape {
+	uint32_t num_pts;
+	const vec2i_t *pts;
+	phx_shape_t *shape;
+} snapshot_shape_t;
+
+
+static void
+put(writer_t *wr, const void *data, size_t size) {
+	static const char zeros[SNAPSHOT_ALIGN];
+	size_t pad = (SNAPSHOT_ALIGN - size % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN;
+	if (size > 0)
+		fwrite(data, 1, size, wr->out);
+	if (pad > 0)
+		fwrite(zeros, 1, pad, wr->out);
+}
+
+static void
+put_u32(writer_t *wr, uint32_t v) {
+	put(wr, &v, sizeof(v));
+}
+
+static void
+put_f64(writer_t *wr, double v) {
+	put(wr, &v, sizeof(v));
+}
+
+static void
+put_vec2(writer_t *wr, vec2_t v) {
+	put(wr, &v, sizeof(v));
+}
+
+static void
+put_str(writer_t *wr, const char *str) {
+	if (!str) {
+		put_u32(wr, SNAPSHOT_NONE);
+		return;
+	}
+	uint32_t len = strlen(str);
+	put_u32(wr, len);
+	put(wr, str, len+1);
+}
+
+static uint32_t
+position_in(ptrset_t *set, void *ptr) {
+	size_t pos;
+	if (!ptr)
+		return SNAPSHOT_NONE;
+	bool found = ptrset_find(set, ptr, &pos);
+	assert(found);
+	return pos;
+}
+
+
+static const void *
+take(reader_t *rd, size_t size) {
+	size_t padded = (size + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+	if (rd->failed || padded < size || (size_t)(rd->end - rd->ptr) < padded) {
+		rd->failed = true;
+		return NULL;
+	}
+	const void *data = rd->ptr;
+	rd->ptr += padded;
+	return data;
+}
+
+static uint32_t
+get_u32(reader_t *rd) {
+	const uint32_t *v = take(rd, sizeof(*v));
+	return v ? *v : 0;
+}
+
+static double
+get_f64(reader_t *rd) {
+	const double *v = take(rd, sizeof(*v));
+	return v ? *v : 0;
+}
+
+static vec2_t
+get_vec2(reader_t *rd) {
+	const vec2_t *v = take(rd, sizeof(*v));
+	return v ? *v : VEC2(0,0);
+}
+
+/**
+ * Read a string from the snapshot. The string points into the mapped file.
+ *
+ * @return The string, or `NULL` if the string was absent or malformed.
+ */
+static const char *
+get_str(reader_t *rd) {
+	uint32_t len = get_u32(rd);
+	if (len == SNAPSHOT_NONE)
+		return NULL;
+	const char *str = take(rd, (size_t)len + 1);
+	if (!str || str[len] != 0) {
+		rd->failed = true;
+		return NULL;
+	}
+	return str;
+}
+
+/**
+ * Read a count followed by an array of @a size bytes per item.
+ */
+static const void *
+get_array(reader_t *rd, uint32_t *num, size_t size) {
+	*num = get_u32(rd);
+	if ((size_t)(rd->end - rd->ptr) / size < *num) {
+		rd->failed = true;
+		*num = 0;
+		return NULL;
+	}
+	return take(rd, *num * size);
+}
+
+/**
+ * Look up the object at a position read from the snapshot.
+ *
+ * @return The object, or `NULL` if the position is out of range.
+ */
+static void *
+get_ref(reader_t *rd, array_t *objects) {
+	uint32_t idx = get_u32(rd);
+	if (idx >= objects->size) {
+		rd->failed = true;
+		return NULL;
+	}
+	return array_at(*objects, void*, idx);
+}
+
+
+
+static void
+write_table(writer_t *wr, phx_table_t *tbl) {
+	if (tbl->num_axes > 0) {
+		// Tables created by phx_table_new list their axes in the order the
+		// strides were assigned, which is recorded in the axis' index.
+		put_u32(wr, SNAPSHOT_TABLE_AXES);
+		put_u32(wr, tbl->num_axes);
+		for (unsigned u = 0; u < tbl->num_axes; ++u) {
+			for (unsigned v = 0; v < tbl->num_axes; ++v) {
+				phx_table_axis_t *axis = tbl->axes + v;
+				if (axis->index != u)
+					continue;
+				put_u32(wr, axis->quantity);
+				put_u32(wr, axis->num_indices);
+				put(wr, axis->indices, axis->num_indices * sizeof(phx_table_index_t));
+			}
+		}
+		put_u32(wr, tbl->size);
+		put(wr, tbl->data, tbl->size * sizeof(double));
+	} else if (tbl->fmt) {
+		phx_table_format_t *fmt = tbl->fmt;
+		put_u32(wr, SNAPSHOT_TABLE_FORMAT);
+		put_u32(wr, fmt->axes_set);
+		for (unsigned u = 0; u < fmt->num_axes; ++u) {
+			phx_table_axis_t *axis = fmt->axes + u;
+			put_u32(wr, axis->stride);
+			put_u32(wr, axis->num_indices);
+			put(wr, axis->indices, axis->num_indices * sizeof(phx_table_index_t));
+		}
+		put_u32(wr, fmt->num_values);
+		put(wr, tbl->data, fmt->num_values * sizeof(double));
+	} else {
+		put_u32(wr, SNAPSHOT_TABLE_SCALAR);
+		put_f64(wr, tbl->data[0]);
+	}
+}
+
+
+static phx_table_t *
+read_table(reader_t *rd) {
+	uint32_t kind = get_u32(rd);
+	if (kind == SNAPSHOT_TABLE_SCALAR) {
+		phx_table_t *tbl = phx_table_create_with_format(NULL);
+		tbl->data[0] = get_f64(rd);
+		return tbl;
+	}
+
+	if (kind == SNAPSHOT_TABLE_AXES) {
+		uint32_t num_axes = get_u32(rd);
+		if (num_axes == 0 || num_axes > PHX_TABLE_MAX_AXES)
+			return NULL;
+		phx_table_quantity_t quantities[num_axes];
+		uint16_t num_indices[num_axes];
+		const phx_table_index_t *indices[num_axes];
+		unsigned axes_set = 0;
+		for (unsigned u = 0; u < num_axes; ++u) {
+			uint32_t num;
+			quantities[u] = get_u32(rd);
+			indices[u] = get_array(rd, &num, sizeof(phx_table_index_t));
+			num_indices[u] = num;
+			unsigned id = PHX_TABLE_INDEX(quantities[u]);
+			if (!indices[u] || num == 0 || num > UINT16_MAX || id >= PHX_TABLE_MAX_AXES || axes_set & (1 << id))
+				return NULL;
+			axes_set |= 1 << id;
+		}
+		uint32_t size;
+		const double *data = get_array(rd, &size, sizeof(double));
+		if (!data)
+			return NULL;
+		phx_table_t *tbl = phx_table_new(num_axes, quantities, num_indices);
+		if (tbl->size != size) {
+			phx_table_unref(tbl);
+			return NULL;
+		}
+		for (unsigned u = 0; u < num_axes; ++u)
+			phx_table_set_indices(tbl, quantities[u], (void*)indices[u]);
+		memcpy(tbl->data, data, size * sizeof(double));
+		return tbl;
+	}
+
+	if (kind == SNAPSHOT_TABLE_FORMAT) {
+		uint32_t axes_set = get_u32(rd);
+		if (axes_set == 0 || axes_set >= (1 << PHX_TABLE_MAX_AXES))
+			return NULL;
+		phx_table_format_t *fmt = phx_table_format_create(axes_set);
+		for (unsigned u = 0; u < fmt->num_axes; ++u) {
+			uint32_t stride = get_u32(rd), num;
+			const phx_table_index_t *indices = get_array(rd, &num, sizeof(phx_table_index_t));
+			if (!indices || num == 0 || num > UINT16_MAX) {
+				phx_table_format_unref(fmt);
+				return NULL;
+			}
+			phx_table_format_set_indices(fmt, fmt->axes[u].id, num, (phx_table_index_t*)indices);
+			phx_table_format_set_stride(fmt, fmt->axes[u].id, stride);
+		}
+		phx_table_format_finalize(fmt);
+		uint32_t num_values;
+		const double *data = get_array(rd, &num_values, sizeof(double));
+		if (!data || num_values != fmt->num_values) {
+			phx_table_format_unref(fmt);
+			return NULL;
+		}
+		phx_table_t *tbl = phx_table_create_with_format(fmt);
+		phx_table_format_unref(fmt);
+		memcpy(tbl->data, data, num_values * sizeof(double));
+		return tbl;
+	}
+
+	return NULL;
+}
+
+
+static void
+collect_tables(writer_t *wr, phx_cell_t *cell) {
+	for (unsigned u = 0; u < cell->arcs.size; ++u) {
+		phx_timing_arc_t *arc = array_get(&cell->arcs, u);
+		if (arc->delay) ptrset_add(&wr->tables, arc->delay);
+		if (arc->transition) ptrset_add(&wr->tables, arc->transition);
+	}
+}
+
+
+static void
+collect_geometry(writer_t *wr, phx_geometry_t *geo) {
+	for (unsigned u = 0; u < geo->layers.size; ++u) {
+		phx_layer_t *layer = array_get(&geo->layers, u);
+		for (unsigned v = 0; v < layer->shapes.size; ++v) {
+			phx_shape_ref_t *ref = array_get(&layer->shapes, v);
+			if (ref->shape->interned)
+				ptrset_add(&wr->shapes, ref->shape);
+		}
+	}
+	for (unsigned u = 0; u < geo->refs.size; ++u) {
+		phx_geometry_ref_t *ref = array_get(&geo->refs, u);
+		if (ptrset_add(&wr->blocks, ref->block))
+			collect_geometry(wr, &ref->block->geo);
+	}
+}
+
+
+static void
+write_geometry(writer_t *wr, phx_geometry_t *geo) {
+	put_u32(wr, geo->layers.size);
+	for (unsigned u = 0; u < geo->layers.size; ++u) {
+		phx_layer_t *layer = array_get(&geo->layers, u);
+		put_u32(wr, position_in(&wr->lib->tech->layers, layer->tech));
+
+		phx_rects_t *rects = &layer->rects;
+		put_u32(wr, rects->size);
+		put(wr, rects->xmin, rects->size * sizeof(int32_t));
+		put(wr, rects->ymin, rects->size * sizeof(int32_t));
+		put(wr, rects->xmax, rects->size * sizeof(int32_t));
+		put(wr, rects->ymax, rects->size * sizeof(int32_t));
+
+		put_u32(wr, layer->shapes.size);
+		for (unsigned v = 0; v < layer->shapes.size; ++v) {
+			phx_shape_ref_t *ref = array_get(&layer->shapes, v);
+			put(wr, &ref->off, sizeof(ref->off));
+			if (ref->shape->interned) {
+				put_u32(wr, SNAPSHOT_SHAPE_INTERNED);
+				put_u32(wr, position_in(&wr->shapes, ref->shape));
+			} else {
+				put_u32(wr, SNAPSHOT_SHAPE_INLINE);
+				put_u32(wr, ref->shape->num_pts);
+				put(wr, ref->shape->pts, ref->shape->num_pts * sizeof(vec2i_t));
+			}
+		}
+
+		put_u32(wr, layer->lines.size);
+		for (unsigned v = 0; v < layer->lines.size; ++v) {
+			phx_line_t *line = array_at(layer->lines, phx_line_t*, v);
+			put_u32(wr, line->width);
+			put_u32(wr, line->num_pts);
+			put(wr, line->pts, line->num_pts * sizeof(vec2i_t));
+		}
+	}
+
+	put_u32(wr, geo->refs.size);
+	for (unsigned u = 0; u < geo->refs.size; ++u) {
+		phx_geometry_ref_t *ref = array_get(&geo->refs, u);
+		put_u32(wr, position_in(&wr->blocks, ref->block));
+		put(wr, &ref->xf, sizeof(ref->xf));
+	}
+}
+
+
+static void
+read_geometry(reader_t *rd, phx_geometry_t *geo) {
+	uint32_t num_layers = get_u32(rd);
+	for (uint32_t u = 0; u < num_layers && !rd->failed; ++u) {
+		phx_tech_layer_t *tech = get_ref(rd, &rd->layers);
+		if (!tech)
+			return;
+		phx_layer_t *layer = phx_geometry_on_layer(geo, tech);
+
+		// Rectangles are referenced in place rather than copied one by one.
+		uint32_t num_rects = get_u32(rd);
+		phx_rects_t rects = { num_rects, num_rects, NULL, NULL, NULL, NULL };
+		if ((size_t)(rd->end - rd->ptr) / (4 * sizeof(int32_t)) < num_rects) {
+			rd->failed = true;
+			return;
+		}
+		rects.xmin = (int32_t*)take(rd, num_rects * sizeof(int32_t));
+		rects.ymin = (int32_t*)take(rd, num_rects * sizeof(int32_t));
+		rects.xmax = (int32_t*)take(rd, num_rects * sizeof(int32_t));
+		rects.ymax = (int32_t*)take(rd, num_rects * sizeof(int32_t));
+		if (rd->failed)
+			return;
+		for (uint32_t v = 0; v < num_rects; ++v) {
+			if (rects.xmin[v] > rects.xmax[v] || rects.ymin[v] > rects.ymax[v]) {
+				rd->failed = true;
+				return;
+			}
+		}
+		phx_layer_add_rects_dbu(layer, &rects);
+
+		uint32_t num_shapes = get_u32(rd);
+		for (uint32_t v = 0; v < num_shapes && !rd->failed; ++v) {
+			const vec2i_t *off = take(rd, sizeof(vec2i_t));
+			uint32_t kind = get_u32(rd);
+			if (!off)
+				return;
+			if (kind == SNAPSHOT_SHAPE_INTERNED) {
+				uint32_t idx = get_u32(rd);
+				if (idx >= rd->shapes.size) {
+					rd->failed = true;
+					return;
+				}
+				snapshot_shape_t *entry = array_get(&rd->shapes, idx);
+				if (!entry->shape) {
+					vec2i_t zero;
+					entry->shape = phx_shape_table_intern(rd->lib->shapes, tech, entry->num_pts, entry->pts, &zero);
+				}
+				phx_layer_add_shape_ref(layer, entry->shape, *off);
+			} else if (kind == SNAPSHOT_SHAPE_INLINE) {
+				uint32_t num_pts;
+				const vec2i_t *src = get_array(rd, &num_pts, sizeof(vec2i_t));
+				if (!src || num_pts < 3 || num_pts > UINT16_MAX) {
+					rd->failed = true;
+					return;
+				}
+				vec2i_t pts[num_pts];
+				for (uint32_t w = 0; w < num_pts; ++w)
+					pts[w] = (vec2i_t){ src[w].x + off->x, src[w].y + off->y };
+				phx_layer_add_shape_dbu(layer, num_pts, pts);
+			} else {
+				rd->failed = true;
+			}
+		}
+
+		uint32_t num_lines = get_u32(rd);
+		for (uint32_t v = 0; v < num_lines && !rd->failed; ++v) {
+			int32_t width = get_u32(rd);
+			uint32_t num_pts;
+			const vec2i_t *pts = get_array(rd, &num_pts, sizeof(vec2i_t));
+			if (!pts || num_pts < 2 || num_pts > UINT16_MAX) {
+				rd->failed = true;
+				return;
+			}
+			phx_layer_add_line_dbu(layer, width, num_pts, (vec2i_t*)pts);
+		}
+	}
+
+	uint32_t num_refs = get_u32(rd);
+	for (uint32_t u = 0; u < num_refs && !rd->failed; ++u) {
+		uint32_t idx = get_u32(rd);
+		const phx_xform_t *xf = take(rd, sizeof(phx_xform_t));
+		if (!xf || idx >= rd->blocks.size) {
+			rd->failed = true;
+			return;
+		}
+		phx_geometry_add_shared(geo, array_at(rd->blocks, phx_geometry_t*, idx), (phx_xform_t*)xf);
+	}
+}
+
+
+static void
+write_tech(writer_t *wr, phx_tech_t *tech) {
+	put_u32(wr, tech->layers.size);
+	for (size_t z = 0; z < tech->layers.size; ++z) {
+		phx_tech_layer_t *layer = tech->layers.items[z];
+		put_str(wr, layer->name);
+		put_u32(wr, layer->has_id);
+		put_u32(wr, layer->id);
+		put(wr, layer->color, sizeof(layer->color));
+		put_f64(wr, layer->min_width);
+		put_f64(wr, layer->min_spacing);
+	}
+	put_u32(wr, tech->vias.size);
+	for (unsigned u = 0; u < tech->vias.size; ++u) {
+		phx_tech_via_t *via = array_get(&tech->vias, u);
+		put_u32(wr, position_in(&tech->layers, via->cut));
+		put_u32(wr, position_in(&tech->layers, via->below));
+		put_u32(wr, position_in(&tech->layers, via->above));
+	}
+}
+
+
+/**
+ * Read the technology layers and vias. Layers that the library's technology
+ * already has, by name or GDS ID, are reused and updated.
+ */
+static void
+read_tech(reader_t *rd, phx_tech_t *tech) {
+	uint32_t num_layers = get_u32(rd);
+	for (uint32_t u = 0; u < num_layers && !rd->failed; ++u) {
+		const char *name = get_str(rd);
+		bool has_id = get_u32(rd);
+		uint32_t id = get_u32(rd);
+		const double *color = take(rd, 3 * sizeof(double));
+		double min_width = get_f64(rd);
+		double min_spacing = get_f64(rd);
+		if (rd->failed)
+			return;
+
+		phx_tech_layer_t *layer = NULL;
+		if (name)
+			layer = phx_tech_find_layer_name(tech, name, false);
+		if (!layer && has_id)
+			layer = phx_tech_find_layer_id(tech, id, false);
+		if (!layer)
+			layer = phx_tech_layer_create(tech);
+		if (name && layer->name != intern_str(name))
+			phx_tech_layer_set_name(layer, name);
+		if (has_id && (!layer->has_id || layer->id != id))
+			phx_tech_layer_set_id(layer, id);
+		memcpy(layer->color, color, sizeof(layer->color));
+		layer->min_width = min_width;
+		layer->min_spacing = min_spacing;
+		array_add(&rd->layers, &layer);
+	}
+
+	uint32_t num_vias = get_u32(rd);
+	for (uint32_t u = 0; u < num_vias && !rd->failed; ++u) {
+		phx_tech_layer_t *cut = get_ref(rd, &rd->layers);
+		phx_tech_layer_t *below = get_ref(rd, &rd->layers);
+		phx_tech_layer_t *above = get_ref(rd, &rd->layers);
+		if (rd->failed)
+			return;
+		bool exists = false;
+		for (unsigned v = 0; v < tech->vias.size && !exists; ++v) {
+			phx_tech_via_t *via = array_get(&tech->vias, v);
+			exists = via->cut == cut && via->below == below && via->above == above;
+		}
+		if (!exists)
+			phx_tech_add_via(tech, cut, below, above);
+	}
+}
+
+
+static void
+write_cell(writer_t *wr, ptrset_t *cells, phx_cell_t *cell) {
+	put_vec2(wr, cell->origin);
+	put_vec2(wr, cell->size);
+	put_f64(wr, cell->leakage_power);
+	write_geometry(wr, &cell->geo);
+
+	for (unsigned u = 0; u < cell->pins.size; ++u)
+		write_geometry(wr, &array_at(cell->pins, phx_pin_t*, u)->geo);
+
+	put_u32(wr, cell->insts.size);
+	for (unsigned u = 0; u < cell->insts.size; ++u) {
+		phx_inst_t *inst = array_at(cell->insts, phx_inst_t*, u);
+		put_u32(wr, position_in(cells, inst->cell));
+		put_str(wr, inst->name);
+		put_u32(wr, inst->orientation);
+		put_vec2(wr, inst->pos);
+	}
+
+	// Terminals refer to their instance by position within the cell, and to
+	// their pin by position within the instantiated cell.
+	put_u32(wr, cell->nets.size);
+	for (unsigned u = 0; u < cell->nets.size; ++u) {
+		phx_net_t *net = array_at(cell->nets, phx_net_t*, u);
+		put_str(wr, net->name);
+		put_u32(wr, net->is_exposed);
+		put_u32(wr, net->conns.size);
+		for (unsigned v = 0; v < net->conns.size; ++v) {
+			phx_terminal_t *term = array_get(&net->conns, v);
+			phx_cell_t *pin_cell = term->inst ? term->inst->cell : cell;
+			uint32_t inst_idx = SNAPSHOT_NONE, pin_idx = SNAPSHOT_NONE;
+			for (unsigned w = 0; w < cell->insts.size && term->inst; ++w)
+				if (array_at(cell->insts, phx_inst_t*, w) == term->inst)
+					inst_idx = w;
+			for (unsigned w = 0; w < pin_cell->pins.size; ++w)
+				if (array_at(pin_cell->pins, phx_pin_t*, w) == term->pin)
+					pin_idx = w;
+			put_u32(wr, inst_idx);
+			put_u32(wr, pin_idx);
+		}
+	}
+
+	put_u32(wr, cell->arcs.size);
+	for (unsigned u = 0; u < cell->arcs.size; ++u) {
+		phx_timing_arc_t *arc = array_get(&cell->arcs, u);
+		uint32_t pin_idx = SNAPSHOT_NONE, related_idx = SNAPSHOT_NONE;
+		for (unsigned w = 0; w < cell->pins.size; ++w) {
+			phx_pin_t *pin = array_at(cell->pins, phx_pin_t*, w);
+			if (pin == arc->pin) pin_idx = w;
+			if (pin == arc->related_pin) related_idx = w;
+		}
+		put_u32(wr, pin_idx);
+		put_u32(wr, related_idx);
+		put_u32(wr, position_in(&wr->tables, arc->delay));
+		put_u32(wr, position_in(&wr->tables, arc->transition));
+	}
+
+	put_u32(wr, cell->gds_text.size);
+	for (unsigned u = 0; u < cell->gds_text.size; ++u) {
+		phx_gds_text_t *text = array_at(cell->gds_text, phx_gds_text_t*, u);
+		put_u32(wr, text->layer);
+		put_u32(wr, text->type);
+		put_vec2(wr, text->pos);
+		put_str(wr, text->text);
+	}
+}
+
+
+static phx_pin_t *
+get_pin(reader_t *rd, phx_cell_t *cell, uint32_t idx) {
+	if (idx >= cell->pins.size) {
+		rd->failed = true;
+		return NULL;
+	}
+	return array_at(cell->pins, phx_pin_t*, idx);
+}
+
+
+static phx_table_t *
+get_table(reader_t *rd) {
+	uint32_t idx = get_u32(rd);
+	if (idx == SNAPSHOT_NONE)
+		return NULL;
+	if (idx >= rd->tables.size) {
+		rd->failed = true;
+		return NULL;
+	}
+	return array_at(rd->tables, phx_table_t*, idx);
+}
+
+
+static void
+read_cell(reader_t *rd, phx_cell_t *cell) {
+	cell->origin = get_vec2(rd);
+	cell->size = get_vec2(rd);
+	cell->leakage_power = get_f64(rd);
+	read_geometry(rd, &cell->geo);
+
+	for (unsigned u = 0; u < cell->pins.size && !rd->failed; ++u)
+		read_geometry(rd, &array_at(cell->pins, phx_pin_t*, u)->geo);
+
+	uint32_t num_insts = get_u32(rd);
+	for (uint32_t u = 0; u < num_insts && !rd->failed; ++u) {
+		phx_cell_t *subcell = get_ref(rd, &rd->cells);
+		const char *name = get_str(rd);
+		uint32_t orientation = get_u32(rd);
+		vec2_t pos = get_vec2(rd);
+		if (rd->failed || orientation > PHX_ROTATE_270)
+			return;
+		phx_inst_t *inst = new_inst(cell, subcell, name);
+		inst->orientation = orientation;
+		inst->pos = pos;
+		phx_inst_update_xform(inst);
+	}
+
+	uint32_t num_nets = get_u32(rd);
+	for (uint32_t u = 0; u < num_nets && !rd->failed; ++u) {
+		phx_net_t *net = calloc(1, sizeof(*net));
+		net->invalid = PHX_ALL_BITS;
+		net->cell = cell;
+		net->name = intern_str(get_str(rd));
+		net->is_exposed = get_u32(rd);
+		array_init(&net->conns, sizeof(phx_terminal_t));
+		array_init(&net->arcs, sizeof(phx_timing_arc_t));
+		array_add(&cell->nets, &net);
+		uint32_t num_conns = get_u32(rd);
+		for (uint32_t v = 0; v < num_conns && !rd->failed; ++v) {
+			uint32_t inst_idx = get_u32(rd), pin_idx = get_u32(rd);
+			phx_terminal_t term = { NULL, NULL };
+			if (inst_idx != SNAPSHOT_NONE) {
+				if (inst_idx >= cell->insts.size) {
+					rd->failed = true;
+					return;
+				}
+				term.inst = array_at(cell->insts, phx_inst_t*, inst_idx);
+			}
+			term.pin = get_pin(rd, term.inst ? term.inst->cell : cell, pin_idx);
+			if (term.pin)
+				array_add(&net->conns, &term);
+		}
+	}
+
+	uint32_t num_arcs = get_u32(rd);
+	for (uint32_t u = 0; u < num_arcs && !rd->failed; ++u) {
+		phx_pin_t *pin = get_pin(rd, cell, get_u32(rd));
+		uint32_t related_idx = get_u32(rd);
+		phx_pin_t *related_pin = related_idx == SNAPSHOT_NONE ? NULL : get_pin(rd, cell, related_idx);
+		phx_table_t *delay = get_table(rd);
+		phx_table_t *transition = get_table(rd);
+		if (rd->failed)
+			return;
+		if (delay)
+			phx_cell_set_timing_table(cell, pin, related_pin, PHX_TIM_DELAY, delay);
+		if (transition)
+			phx_cell_set_timing_table(cell, pin, related_pin, PHX_TIM_TRANS, transition);
+	}
+
+	uint32_t num_texts = get_u32(rd);
+	for (uint32_t u = 0; u < num_texts && !rd->failed; ++u) {
+		uint32_t layer = get_u32(rd);
+		uint32_t type = get_u32(rd);
+		vec2_t pos = get_vec2(rd);
+		const char *text = get_str(rd);
+		if (text)
+			phx_cell_add_gds_text(cell, layer, type, pos, text);
+	}
+}
+
+
+/**
+ * Save a library and its technology to a snapshot file, which can be loaded
+ * with phx_library_load.
+ *
+ * @return `PHALANX_OK` on success, or a negative `errno` value if the file
+ * cannot be written.
+ */
+int
+phx_library_save(phx_library_t *lib, const char *path) {
+	assert(lib && path);
+	writer_t wr;
+	memset(&wr, 0, sizeof(wr));
+	wr.lib = lib;
+	wr.out = fopen(path, "wb");
+	if (!wr.out)
+		return -errno;
+
+	// Gather the objects that are shared and referred to by position.
+	phx_tech_t *tech = lib->tech;
+	ptrset_t cells;
+	ptrset_init(&cells);
+	for (unsigned u = 0; u < lib->cells.size; ++u) {
+		phx_cell_t *cell = array_at(lib->cells, phx_cell_t*, u);
+		ptrset_add(&cells, cell);
+		collect_tables(&wr, cell);
+		collect_geometry(&wr, &cell->geo);
+		for (unsigned v = 0; v < cell->pins.size; ++v)
+			collect_geometry(&wr, &array_at(cell->pins, phx_pin_t*, v)->geo);
+	}
+
+	// Cells are stored in the library's order, but referred to by their
+	// position in the set.
+	put(&wr, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	put_u32(&wr, SNAPSHOT_VERSION);
+	put_u32(&wr, SNAPSHOT_BOM);
+	write_tech(&wr, tech);
+	put_f64(&wr, lib->dbu);
+	put_u32(&wr, lib->shapes != NULL);
+
+	put_u32(&wr, lib->cells.size);
+	for (unsigned u = 0; u < lib->cells.size; ++u) {
+		phx_cell_t *cell = array_at(lib->cells, phx_cell_t*, u);
+		put_u32(&wr, position_in(&cells, cell));
+		put_str(&wr, cell->name);
+		put_u32(&wr, cell->pins.size);
+		for (unsigned v = 0; v < cell->pins.size; ++v) {
+			phx_pin_t *pin = array_at(cell->pins, phx_pin_t*, v);
+			put_str(&wr, pin->name);
+			put_f64(&wr, pin->capacitance);
+		}
+	}
+
+	put_u32(&wr, wr.tables.size);
+	for (size_t z = 0; z < wr.tables.size; ++z)
+		write_table(&wr, wr.tables.items[z]);
+
+	put_u32(&wr, wr.shapes.size);
+	for (size_t z = 0; z < wr.shapes.size; ++z) {
+		phx_shape_t *shape = wr.shapes.items[z];
+		put_u32(&wr, shape->num_pts);
+		put(&wr, shape->pts, shape->num_pts * sizeof(vec2i_t));
+	}
+
+	put_u32(&wr, wr.blocks.size);
+	for (size_t z = 0; z < wr.blocks.size; ++z) {
+		phx_geometry_block_t *block = wr.blocks.items[z];
+		put_u32(&wr, position_in(&cells, block->geo.cell));
+		write_geometry(&wr, &block->geo);
+	}
+
+	for (unsigned u = 0; u < lib->cells.size; ++u)
+		write_cell(&wr, &cells, array_at(lib->cells, phx_cell_t*, u));
+
+	int err = ferror(wr.out) ? -EIO : PHALANX_OK;
+	if (fclose(wr.out) != 0 && err == PHALANX_OK)
+		err = -errno;
+	ptrset_dispose(&cells);
+	ptrset_dispose(&wr.tables);
+	ptrset_dispose(&wr.shapes);
+	ptrset_dispose(&wr.blocks);
+	return err;
+}
+
+
+static int
+read_snapshot(reader_t *rd) {
+	phx_library_t *lib = rd->lib;
+	const char *magic = take(rd, sizeof(SNAPSHOT_MAGIC));
+	if (!magic || memcmp(magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+	    get_u32(rd) != SNAPSHOT_VERSION || get_u32(rd) != SNAPSHOT_BOM)
+		return PHALANX_ERR_SNAPSHOT;
+
+	read_tech(rd, lib->tech);
+	double dbu = get_f64(rd);
+	bool interned = get_u32(rd);
+	if (rd->failed || !(dbu > 0))
+		return PHALANX_ERR_SNAPSHOT;
+	phx_library_set_dbu(lib, dbu);
+	if (interned)
+		phx_library_intern_shapes(lib);
+
+	// Create all cells and their pins up front, such that instances and
+	// terminals can refer to them regardless of order.
+	uint32_t num_cells = get_u32(rd);
+	if (num_cells > (size_t)(rd->end - rd->ptr))
+		return PHALANX_ERR_SNAPSHOT;
+	array_resize(&rd->cells, num_cells);
+	memset(rd->cells.items, 0, num_cells * sizeof(phx_cell_t*));
+	for (uint32_t u = 0; u < num_cells && !rd->failed; ++u) {
+		uint32_t pos = get_u32(rd);
+		const char *name = get_str(rd);
+		if (!name || pos >= num_cells || array_at(rd->cells, phx_cell_t*, pos))
+			return PHALANX_ERR_SNAPSHOT;
+		phx_cell_t *cell = new_cell(lib, name);
+		array_at(rd->cells, phx_cell_t*, pos) = cell;
+		uint32_t num_pins = get_u32(rd);
+		for (uint32_t v = 0; v < num_pins && !rd->failed; ++v) {
+			const char *pin_name = get_str(rd);
+			double capacitance = get_f64(rd);
+			if (!pin_name || strmap_get(&cell->pins_by_name, pin_name))
+				return PHALANX_ERR_SNAPSHOT;
+			cell_find_pin(cell, pin_name)->capacitance = capacitance;
+		}
+	}
+
+	uint32_t num_tables = get_u32(rd);
+	for (uint32_t u = 0; u < num_tables && !rd->failed; ++u) {
+		phx_table_t *tbl = read_table(rd);
+		if (!tbl)
+			return PHALANX_ERR_SNAPSHOT;
+		array_add(&rd->tables, &tbl);
+	}
+
+	uint32_t num_shapes = get_u32(rd);
+	if (num_shapes > 0 && !lib->shapes)
+		return PHALANX_ERR_SNAPSHOT;
+	for (uint32_t u = 0; u < num_shapes && !rd->failed; ++u) {
+		uint32_t num_pts;
+		const vec2i_t *pts = get_array(rd, &num_pts, sizeof(vec2i_t));
+		if (!pts || num_pts < 3 || num_pts > UINT16_MAX)
+			return PHALANX_ERR_SNAPSHOT;
+		snapshot_shape_t entry = { num_pts, pts, NULL };
+		array_add(&rd->shapes, &entry);
+	}
+
+	// Shared blocks are rebuilt as standalone geometries. The first reference
+	// moves their layers into a block that all later references share.
+	uint32_t num_blocks = get_u32(rd);
+	for (uint32_t u = 0; u < num_blocks && !rd->failed; ++u) {
+		phx_cell_t *cell = get_ref(rd, &rd->cells);
+		if (!cell)
+			return PHALANX_ERR_SNAPSHOT;
+		phx_geometry_t *geo = malloc(sizeof(*geo));
+		phx_geometry_init(geo, cell);
+		array_add(&rd->blocks, &geo);
+		read_geometry(rd, geo);
+	}
+
+	// The cells were created in the order they are stored in.
+	for (uint32_t u = 0; u < num_cells && !rd->failed; ++u)
+		read_cell(rd, array_at(lib->cells, phx_cell_t*, u));
+
+	return rd->failed ? PHALANX_ERR_SNAPSHOT : PHALANX_OK;
+}
+
+
+/**
+ * Load a snapshot written by phx_library_save into an empty library. Layers
+ * of the snapshot's technology that the library's technology already has, by
+ * name or GDS ID, are reused. The library may be partially filled if loading
+ * fails.
+ *
+ * @return `PHALANX_OK` on success, `PHALANX_ERR_LIBRARY_NOT_EMPTY` if the
+ * library already has cells, `PHALANX_ERR_SNAPSHOT` if the file is not a valid
+ * snapshot, or a negative `errno` value if the file cannot be read.
+ */
+int
+phx_library_load(phx_library_t *lib, const char *path) {
+	assert(lib && path);
+	if (lib->cells.size > 0)
+		return PHALANX_ERR_LIBRARY_NOT_EMPTY;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		int err = -errno;
+		close(fd);
+		return err;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return PHALANX_ERR_SNAPSHOT;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int err = data == MAP_FAILED ? -errno : PHALANX_OK;
+	close(fd);
+	if (err != PHALANX_OK)
+		return err;
+
+	reader_t rd;
+	memset(&rd, 0, sizeof(rd));
+	rd.base = data;
+	rd.ptr = data;
+	rd.end = rd.base + st.st_size;
+	rd.lib = lib;
+	array_init(&rd.layers, sizeof(phx_tech_layer_t*));
+	array_init(&rd.cells, sizeof(phx_cell_t*));
+	array_init(&rd.tables, sizeof(phx_table_t*));
+	array_init(&rd.shapes, sizeof(snapshot_shape_t));
+	array_init(&rd.blocks, sizeof(phx_geometry_t*));
+
+	err = read_snapshot(&rd);
+
+	// The cells hold their own references to the tables and shared blocks.
+	for (unsigned u = 0; u < rd.tables.size; ++u)
+		phx_table_unref(array_at(rd.tables, phx_table_t*, u));
+	for (unsigned u = 0; u < rd.blocks.size; ++u) {
+		phx_geometry_t *geo = array_at(rd.blocks, phx_geometry_t*, u);
+		phx_geometry_dispose(geo);
+		free(geo);
+	}
+	array_dispose(&rd.layers);
+	array_dispose(&rd.cells);
+	array_dispose(&rd.tables);
+	array_dispose(&rd.shapes);
+	array_dispose(&rd.blocks);
+	munmap(data, st.st_size);
+	return err;
+}
@@ -42,6 +42,7 @@ struct phx_context {
 	gds_lib_t *gds;
 	phx_geometry_t *geometry;
 	phx_layer_t *layer;
+	phx_tech_filter_t *filter;
 };
 
 static void phx_lexer_init(phx_lexer_t *lex, FILE *file);
@@ -254,6 +255,44 @@ parse_sub(phx_lexer_t *lex, const phx_context_t *ctx) {
 }
 
 
+/**
+ * Parses the file names of a load command, followed by an optional block that
+ * restricts the layers to be loaded. The file names are added to @a files.
+ *
+ * @return `true` if a layer filter block was present and @a filter has been
+ * initialized, `false` otherwise. In the former case the command is not
+ * followed by a semicolon.
+ */
+static bool
+parse_load_args(phx_lexer_t *lex, const phx_context_t *ctx, array_t *files, phx_tech_filter_t *filter) {
+	assert(lex && ctx && files && filter);
+	array_init(files, sizeof(char*));
+	while (lex->tkn == PHX_IDENT) {
+		char *file = dupstr(lex->text);
+		array_add(files, &file);
+		phx_lexer_next(lex);
+	}
+	if (lex->tkn != PHX_LBRACE)
+		return false;
+	phx_tech_filter_init(filter);
+	phx_context_t subctx = *ctx;
+	subctx.filter = filter;
+	parse_sub(lex, &subctx);
+	return true;
+}
+
+
+static void
+free_load_args(array_t *files, phx_tech_filter_t *filter) {
+	assert(files);
+	for (unsigned u = 0; u < files->size; ++u)
+		free(array_at(*files, char*, u));
+	array_dispose(files);
+	if (filter)
+		phx_tech_filter_dispose(filter);
+}
+
+
 static void
 copy_gds(phx_library_t *lib, gds_struct_t *subgds, gds_lib_t *gds) {
 	assert(lib && subgds && gds);
@@ -318,18 +357,24 @@ parse(phx_lexer_t *lex, const phx_context_t *ctx) {
 	if (strcmp(lex->text, "load_lef") == 0) {
 		assert(ctx->lib);
 		phx_lexer_next(lex);
-		while (lex->tkn == PHX_IDENT) {
+		array_t files;
+		phx_tech_filter_t filter;
+		bool filtered = parse_load_args(lex, ctx, &files, &filter);
+		for (unsigned u = 0; u < files.size; ++u) {
+			const char *file = array_at(files, char*, u);
 			lef_t *in;
-			int res = lef_read(&in, lex->text);
+			int res = lef_read(&in, file);
 			if (res != PHALANX_OK) {
-				fprintf(stderr, "Unable to read LEF file %s: %s\n", lex->text, errstr(res));
+				fprintf(stderr, "Unable to read LEF file %s: %s\n", file, errstr(res));
 				exit(1);
 			}
-			load_lef(ctx->lib, in, ctx->lib->tech);
-			fprintf(stderr, "Loaded %u cells from %s\n", (unsigned)lef_get_num_macros(in), lex->text);
+			load_lef(ctx->lib, in, ctx->lib->tech, filtered ? &filter : NULL);
+			fprintf(stderr, "Loaded %u cells from %s\n", (unsigned)lef_get_num_macros(in), file);
 			lef_free(in);
-			phx_lexer_next(lex);
 		}
+		free_load_args(&files, filtered ? &filter : NULL);
+		if (filtered)
+			return;
 	}
 	else if (strcmp(lex->text, "load_lib") == 0) {
 		assert(ctx->lib);
@@ -352,25 +397,186 @@ parse(phx_lexer_t *lex, const phx_context_t *ctx) {
 	else if (strcmp(lex->text, "load_gds") == 0) {
 		assert(ctx->lib);
 		phx_lexer_next(lex);
-		while (lex->tkn == PHX_IDENT) {
+		array_t files;
+		phx_tech_filter_t filter;
+		bool filtered = parse_load_args(lex, ctx, &files, &filter);
+		for (unsigned u = 0; u < files.size; ++u) {
+			const char *file = array_at(files, char*, u);
 			gds_lib_t *in;
 			gds_reader_t *rd;
-			int res = gds_reader_open_file(&rd, lex->text, 0);
+			int res = gds_reader_open_file(&rd, file, 0);
 			if (res != GDS_OK) {
-				fprintf(stderr, "Unable to open GDS file %s: %s\n", lex->text, gds_errstr(res));
+				fprintf(stderr, "Unable to open GDS file %s: %s\n", file, gds_errstr(res));
 				exit(1);
 			}
 			res = gds_lib_read(&in, rd);
 			if (res != GDS_OK) {
-				fprintf(stderr, "Unable to read GDS file %s: %s\n", lex->text, gds_errstr(res));
+				fprintf(stderr, "Unable to read GDS file %s: %s\n", file, gds_errstr(res));
 				exit(1);
 			}
 			gds_reader_close(rd);
-			load_gds(ctx->lib, in, ctx->lib->tech);
-			fprintf(stderr, "Loaded %u cells from %s\n", (unsigned)gds_lib_get_num_structs(in), lex->text);
+			load_gds(ctx->lib, in, ctx->lib->tech, filtered ? &filter : NULL);
+			fprintf(stderr, "Loaded %u cells from %s\n", (unsigned)gds_lib_get_num_structs(in), file);
 			gds_lib_destroy(in);
+		}
+		free_load_args(&files, filtered ? &filter : NULL);
+		if (filtered)
+			return;
+	}
+	else if (strcmp(lex->text, "only_layers") == 0 || strcmp(lex->text, "skip_layers") == 0) {
+		assert(ctx->filter && ctx->lib->tech);
+		bool allow = strcmp(lex->text, "only_layers") == 0;
+		phx_lexer_next(lex);
+		while (lex->tkn == PHX_IDENT) {
+			phx_tech_layer_t *layer = phx_tech_find_layer_name(ctx->lib->tech, lex->text, false);
+			if (!layer) {
+				fprintf(stderr, "Cannot find layer '%s'\n", lex->text);
+				exit(1);
+			}
+			if (allow)
+				phx_tech_filter_allow(ctx->filter, layer);
+			else
+				phx_tech_filter_deny(ctx->filter, layer);
+			phx_lexer_next(lex);
+		}
+	}
+	else if (strcmp(lex->text, "set_dbu") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		double dbu = require_real(lex);
+		if (dbu <= 0) {
+			fprintf(stderr, "Database unit must be positive\n");
+			exit(1);
+		}
+		phx_library_set_dbu(ctx->lib, dbu);
+	}
+	else if (strcmp(lex->text, "save_library") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		assert(lex->tkn == PHX_IDENT);
+		phx_library_update(ctx->lib, PHX_ALL_BITS);
+		int res = phx_library_save(ctx->lib, lex->text);
+		if (res != PHALANX_OK) {
+			fprintf(stderr, "Unable to save library to %s: %s\n", lex->text, errstr(res));
+			exit(1);
+		}
+		phx_lexer_next(lex);
+	}
+	else if (strcmp(lex->text, "load_library") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		assert(lex->tkn == PHX_IDENT);
+		int res = phx_library_load(ctx->lib, lex->text);
+		if (res != PHALANX_OK) {
+			fprintf(stderr, "Unable to load library from %s: %s\n", lex->text, errstr(res));
+			exit(1);
+		}
+		fprintf(stderr, "Loaded %u cells from %s\n", (unsigned)ctx->lib->cells.size, lex->text);
+		phx_lexer_next(lex);
+	}
+	else if (strcmp(lex->text, "set_num_threads") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		int num_threads = require_int(lex);
+		if (num_threads <= 0) {
+			fprintf(stderr, "Number of threads must be positive\n");
+			exit(1);
+		}
+		phx_library_set_num_threads(ctx->lib, num_threads);
+	}
+	else if (strcmp(lex->text, "mem_report") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		int max_cells = 10;
+		if (lex->tkn != PHX_SEMICOLON)
+			max_cells = require_int(lex);
+		if (max_cells < 0) {
+			fprintf(stderr, "Number of cells to report must not be negative\n");
+			exit(1);
+		}
+		report_memory(ctx->lib, stdout, max_cells);
+	}
+	else if (strcmp(lex->text, "start_trace") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		phx_library_start_trace(ctx->lib);
+	}
+	else if (strcmp(lex->text, "stop_trace") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		phx_library_stop_trace(ctx->lib);
+	}
+	else if (strcmp(lex->text, "trace_report") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		int max_cells = 10;
+		if (lex->tkn != PHX_SEMICOLON)
+			max_cells = require_int(lex);
+		if (max_cells < 0) {
+			fprintf(stderr, "Number of cells to report must not be negative\n");
+			exit(1);
+		}
+		if (!phx_library_get_trace(ctx->lib)) {
+			fprintf(stderr, "Library is not being traced, use start_trace first\n");
+			exit(1);
+		}
+		report_trace(ctx->lib, stdout, max_cells);
+	}
+	else if (strcmp(lex->text, "write_trace") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		assert(lex->tkn == PHX_IDENT);
+		if (!phx_library_get_trace(ctx->lib)) {
+			fprintf(stderr, "Library is not being traced, use start_trace first\n");
+			exit(1);
+		}
+		FILE *f = fopen(lex->text, "w");
+		if (!f) {
+			fprintf(stderr, "Unable to open trace file %s, %s\n", lex->text, strerror(errno));
+			exit(1);
+		}
+		write_trace_events(ctx->lib, f);
+		fclose(f);
+		phx_lexer_next(lex);
+	}
+	else if (strcmp(lex->text, "intern_shapes") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		phx_library_intern_shapes(ctx->lib);
+	}
+	else if (strcmp(lex->text, "tech_via") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		phx_tech_layer_t *layers[3];
+		for (unsigned u = 0; u < 3; ++u) {
+			assert(lex->tkn == PHX_IDENT);
+			layers[u] = phx_tech_find_layer_name(ctx->lib->tech, lex->text, false);
+			if (!layers[u]) {
+				fprintf(stderr, "Cannot find layer '%s'\n", lex->text);
+				exit(1);
+			}
 			phx_lexer_next(lex);
 		}
+		phx_tech_add_via(ctx->lib->tech, layers[0], layers[1], layers[2]);
+	}
+	else if (strcmp(lex->text, "tech_rule") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		assert(lex->tkn == PHX_IDENT);
+		phx_tech_layer_t *layer = phx_tech_find_layer_name(ctx->lib->tech, lex->text, false);
+		if (!layer) {
+			fprintf(stderr, "Cannot find layer '%s'\n", lex->text);
+			exit(1);
+		}
+		phx_lexer_next(lex);
+		double width = require_real(lex);
+		double spacing = require_real(lex);
+		if (width < 0 || spacing < 0) {
+			fprintf(stderr, "Minimum width and spacing must not be negative\n");
+			exit(1);
+		}
+		phx_tech_layer_set_min_width(layer, width);
+		phx_tech_layer_set_min_spacing(layer, spacing);
 	}
 	else if (strcmp(lex->text, "cell") == 0) {
 		assert(ctx->lib);
@@ -409,6 +615,14 @@ parse(phx_lexer_t *lex, const phx_context_t *ctx) {
 		parse_sub(lex, &subctx);
 		return;
 	}
+	else if (strcmp(lex->text, "edit") == 0) {
+		assert(ctx->lib);
+		phx_lexer_next(lex);
+		phx_library_begin_edit(ctx->lib);
+		parse_sub(lex, ctx);
+		phx_library_commit_edit(ctx->lib);
+		return;
+	}
 	else if (strcmp(lex->text, "geometry") == 0) {
 		assert(ctx->cell);
 		phx_lexer_next(lex);
@@ -511,7 +725,7 @@ parse(phx_lexer_t *lex, const phx_context_t *ctx) {
 		assert(ctx->cell);
 		phx_lexer_next(lex);
 		assert(lex->tkn == PHX_IDENT);
-		phx_cell_update(ctx->cell, PHX_ALL_BITS);
+		phx_library_update(ctx->cell->lib, PHX_ALL_BITS);
 		plot_cell_as_pdf(ctx->cell, lex->text);
 		phx_lexer_next(lex);
 	}
@@ -542,6 +756,22 @@ parse(phx_lexer_t *lex, const phx_context_t *ctx) {
 		phx_inst_copy_geometry_to_parent(src_inst, &src_pin->geo, &dst_pin->geo);
 	}
 
+	else if (strcmp(lex->text, "merge_geometry") == 0) {
+		assert(ctx->cell);
+		phx_lexer_next(lex);
+		if (ctx->layer) {
+			phx_layer_merge(ctx->layer);
+		} else if (ctx->geometry) {
+			phx_geometry_merge(ctx->geometry);
+		} else if (ctx->pin) {
+			phx_geometry_merge(phx_pin_get_geometry(ctx->pin));
+		} else {
+			phx_geometry_merge(phx_cell_get_geometry(ctx->cell));
+			for (unsigned u = 0, un = phx_cell_get_num_pins(ctx->cell); u < un; ++u)
+				phx_geometry_merge(phx_pin_get_geometry(phx_cell_get_pin(ctx->cell, u)));
+		}
+	}
+
 	else if (strcmp(lex->text, "connect") == 0) {
 		assert(ctx->cell);
 		phx_lexer_next(lex);
@@ -554,6 +784,20 @@ parse(phx_lexer_t *lex, const phx_context_t *ctx) {
 		}
 	}
 
+	else if (strcmp(lex->text, "check_connectivity") == 0) {
+		assert(ctx->cell);
+		phx_lexer_next(lex);
+		phx_library_update(ctx->cell->lib, PHX_ALL_BITS);
+		check_connectivity(ctx->cell, stdout);
+	}
+
+	else if (strcmp(lex->text, "check_spacing") == 0) {
+		assert(ctx->cell);
+		phx_lexer_next(lex);
+		phx_library_update(ctx->cell->lib, PHX_ALL_BITS);
+		check_spacing(ctx->cell, stdout);
+	}
+
 	else if (strcmp(lex->text, "copy_cell_gds") == 0) {
 		assert(ctx->gds && ctx->lib);
 		phx_lexer_next(lex);
@@ -583,6 +827,7 @@ parse(phx_lexer_t *lex, const phx_context_t *ctx) {
 			exit(1);
 		}
 		phx_lexer_next(lex);
+		phx_library_update(ctx->lib, PHX_ALL_BITS);
 		make_gds_for_cell(ctx->lib, cell, ctx->gds);
 		// gds_struct_t *str = cell_to_gds(cell, ctx->gds);
 		// gds_lib_add_struct(ctx->gds, str);
@@ -29,6 +29,302 @@ dump_cell_nets(phx_cell_t *cell, FILE *out) {
 }
 
 
+static void
+print_terminal(phx_terminal_t *term, FILE *out) {
+	if (term->inst)
+		fprintf(out, "%s.%s", term->inst->name, term->pin->name);
+	else
+		fprintf(out, "%s", term->pin->name);
+}
+
+
+static int
+compare_extracted_terminals(const void *pa, const void *pb) {
+	const phx_extracted_terminal_t *a = pa, *b = pb;
+	if (a->term.inst != b->term.inst)
+		return (uintptr_t)a->term.inst < (uintptr_t)b->term.inst ? -1 : 1;
+	if (a->term.pin != b->term.pin)
+		return (uintptr_t)a->term.pin < (uintptr_t)b->term.pin ? -1 : 1;
+	return 0;
+}
+
+
+/**
+ * Compare the nets declared in a cell against the connectivity extracted from
+ * its geometry. Reports nets whose terminals are not connected by geometry,
+ * and nets whose terminals are connected to each other by geometry. Terminals
+ * whose pin has no geometry are ignored.
+ *
+ * @return The number of problems found.
+ */
+unsigned
+check_connectivity(phx_cell_t *cell, FILE *out) {
+	assert(cell && out);
+	array_t terms;
+	array_init(&terms, sizeof(phx_extracted_terminal_t));
+	unsigned num_groups = phx_cell_extract_connectivity(cell, &terms);
+	qsort(terms.items, terms.size, terms.item_size, compare_extracted_terminals);
+
+	phx_net_t **group_nets = calloc(num_groups, sizeof(phx_net_t*));
+	bool *group_reported = calloc(num_groups, sizeof(bool));
+	unsigned num_problems = 0;
+
+	for (unsigned u = 0; u < cell->nets.size; ++u) {
+		phx_net_t *net = array_at(cell->nets, phx_net_t*, u);
+		phx_extracted_terminal_t *first = NULL;
+		bool open_reported = false;
+		for (unsigned v = 0; v < net->conns.size; ++v) {
+			phx_extracted_terminal_t key = { *(phx_terminal_t*)array_get(&net->conns, v), 0 };
+			phx_extracted_terminal_t *found = bsearch(&key, terms.items, terms.size, terms.item_size, compare_extracted_terminals);
+			if (!found)
+				continue;
+
+			// All terminals of the net must be in the same group.
+			if (!first) {
+				first = found;
+			} else if (found->group != first->group && !open_reported) {
+				fprintf(out, "net %s is open: ", net->name);
+				print_terminal(&first->term, out);
+				fprintf(out, " and ");
+				print_terminal(&found->term, out);
+				fprintf(out, " are not connected\n");
+				open_reported = true;
+				++num_problems;
+			}
+
+			// No other net may be in the same group.
+			phx_net_t *other = group_nets[found->group];
+			if (other && other != net && !group_reported[found->group]) {
+				fprintf(out, "nets %s and %s are shorted at ", other->name, net->name);
+				print_terminal(&found->term, out);
+				fprintf(out, "\n");
+				group_reported[found->group] = true;
+				++num_problems;
+			}
+			group_nets[found->group] = net;
+		}
+	}
+
+	fprintf(out, "%u terminals in %u connected groups, %u problems\n", terms.size, num_groups, num_problems);
+	free(group_nets);
+	free(group_reported);
+	array_dispose(&terms);
+	return num_problems;
+}
+
+
+static void
+print_violation_side(phx_cell_t *cell, phx_inst_t *inst, phx_rect_t box, FILE *out) {
+	vec2_t min = phx_library_vec_from_dbu(cell->lib, box.min);
+	vec2_t max = phx_library_vec_from_dbu(cell->lib, box.max);
+	fprintf(out, "%s [%g %g %g %g]", inst ? inst->name : cell->name, min.x, min.y, max.x, max.y);
+}
+
+
+/**
+ * Check the geometry of a cell against the minimum width and spacing rules
+ * of the technology, and report every violation found.
+ *
+ * @return The number of violations found.
+ */
+unsigned
+check_spacing(phx_cell_t *cell, FILE *out) {
+	assert(cell && out);
+	array_t violations;
+	array_init(&violations, sizeof(phx_spacing_violation_t));
+	size_t checked;
+	unsigned num = phx_cell_check_spacing(cell, &violations, &checked);
+
+	for (unsigned u = 0; u < num; ++u) {
+		phx_spacing_violation_t *v = array_get(&violations, u);
+		double measured = phx_library_from_dbu(cell->lib, v->measured);
+		if (v->width) {
+			fprintf(out, "layer %s too narrow: %g < %g at ", v->layer->name, measured, v->layer->min_width);
+			print_violation_side(cell, v->inst_a, v->box_a, out);
+		} else {
+			fprintf(out, "layer %s too close: %g < %g between ", v->layer->name, measured, v->layer->min_spacing);
+			print_violation_side(cell, v->inst_a, v->box_a, out);
+			fprintf(out, " and ");
+			print_violation_side(cell, v->inst_b, v->box_b, out);
+		}
+		fprintf(out, "\n");
+	}
+
+	if (checked == 0)
+		fprintf(out, "no geometry on layers with width or spacing rules\n");
+	fprintf(out, "%u spacing violations\n", num);
+	array_dispose(&violations);
+	return num;
+}
+
+
+static void
+print_bytes(FILE *out, size_t bytes) {
+	if (bytes >= 1 << 20)
+		fprintf(out, "%8.1f MB", bytes / 1048576.0);
+	else
+		fprintf(out, "%8.1f KB", bytes / 1024.0);
+}
+
+typedef struct cell_usage {
+	phx_cell_t *cell;
+	size_t bytes;
+} cell_usage_t;
+
+static int
+compare_cell_usage(const cell_usage_t *a, const cell_usage_t *b) {
+	return a->bytes < b->bytes ? 1 : a->bytes > b->bytes ? -1 : 0;
+}
+
+/**
+ * Print how much memory a library holds, broken down by what it is used for
+ * and by layer, followed by the @a max_cells cells that hold the most memory.
+ */
+void
+report_memory(phx_library_t *lib, FILE *out, unsigned max_cells) {
+	assert(lib && out);
+	phx_memory_report_t report;
+	phx_library_memory_report(lib, &report);
+
+	size_t total = report.cells + report.geometry + report.tables + report.shapes + report.names;
+	fprintf(out, "memory:     "); print_bytes(out, total); fprintf(out, "\n");
+	fprintf(out, "  cells     "); print_bytes(out, report.cells); fprintf(out, "\n");
+	fprintf(out, "  geometry  "); print_bytes(out, report.geometry); fprintf(out, "\n");
+	fprintf(out, "  tables    "); print_bytes(out, report.tables); fprintf(out, "\n");
+	fprintf(out, "  shapes    "); print_bytes(out, report.shapes); fprintf(out, "\n");
+	fprintf(out, "  names     "); print_bytes(out, report.names); fprintf(out, "\n");
+	if (report.num_gds > 0)
+		fprintf(out, "  excluded  %u raw GDS structures with %u elements\n", report.num_gds, report.num_gds_elems);
+
+	fprintf(out, "by layer:\n");
+	phx_tech_t *tech = lib->tech;
+	for (size_t z = 0; z < tech->layers.size; ++z) {
+		phx_tech_layer_t *layer = tech->layers.items[z];
+		size_t bytes = array_at(report.by_layer, size_t, layer->index);
+		if (bytes == 0)
+			continue;
+		fprintf(out, "  ");
+		print_bytes(out, bytes);
+		if (layer->name)
+			fprintf(out, "  %s\n", layer->name);
+		else
+			fprintf(out, "  %u/%u\n", layer->id >> 16, layer->id & 0xFFFF);
+	}
+
+	unsigned num_cells = report.by_cell.size;
+	cell_usage_t *cells = malloc(num_cells * sizeof(cell_usage_t));
+	for (unsigned u = 0; u < num_cells; ++u) {
+		cells[u].cell = array_at(lib->cells, phx_cell_t*, u);
+		cells[u].bytes = array_at(report.by_cell, size_t, u);
+	}
+	qsort(cells, num_cells, sizeof(cell_usage_t), (void*)compare_cell_usage);
+	if (max_cells > num_cells)
+		max_cells = num_cells;
+	fprintf(out, "by cell (largest %u of %u):\n", max_cells, num_cells);
+	for (unsigned u = 0; u < max_cells; ++u) {
+		fprintf(out, "  ");
+		print_bytes(out, cells[u].bytes);
+		fprintf(out, "  %s\n", cells[u].cell->name);
+	}
+
+	free(cells);
+	phx_memory_report_dispose(&report);
+}
+
+
+typedef struct cell_time {
+	phx_trace_cell_t *tc;
+	uint64_t time_ns;
+} cell_time_t;
+
+static int
+compare_cell_time(const cell_time_t *a, const cell_time_t *b) {
+	return a->time_ns < b->time_ns ? 1 : a->time_ns > b->time_ns ? -1 : 0;
+}
+
+/**
+ * Print the updates recorded by a library's trace, by kind of update and for
+ * the @a max_cells cells that took the longest to update. The time of a cell
+ * excludes net timing updates, which run as part of the cell's timing update.
+ */
+void
+report_trace(phx_library_t *lib, FILE *out, unsigned max_cells) {
+	assert(lib && out);
+	phx_trace_t *trace = phx_library_get_trace(lib);
+	assert(trace);
+
+	fprintf(out, "update            calls        hits   time [ms]\n");
+	for (unsigned u = 0; u < PHX_NUM_UPDATE_KINDS; ++u) {
+		phx_update_counter_t *c = &trace->counters[u];
+		fprintf(out, "  %-12s %10llu  %10llu  %10.3f\n", phx_update_kind_name(u),
+			(unsigned long long)c->calls, (unsigned long long)c->hits, c->time_ns * 1e-6);
+	}
+
+	unsigned num_cells = trace->cells.size;
+	cell_time_t *cells = malloc(num_cells * sizeof(cell_time_t));
+	for (unsigned u = 0; u < num_cells; ++u) {
+		phx_trace_cell_t *tc = array_at(trace->cells, phx_trace_cell_t*, u);
+		cells[u].tc = tc;
+		cells[u].time_ns = 0;
+		for (unsigned v = 0; v < PHX_NUM_UPDATE_KINDS; ++v)
+			if (v != PHX_UPDATE_NET_TIMING)
+				cells[u].time_ns += tc->counters[v].time_ns;
+	}
+	qsort(cells, num_cells, sizeof(cell_time_t), (void*)compare_cell_time);
+	if (max_cells > num_cells)
+		max_cells = num_cells;
+	fprintf(out, "by cell (slowest %u of %u):\n", max_cells, num_cells);
+	for (unsigned u = 0; u < max_cells; ++u) {
+		uint64_t calls = 0, hits = 0;
+		for (unsigned v = 0; v < PHX_NUM_UPDATE_KINDS; ++v) {
+			calls += cells[u].tc->counters[v].calls;
+			hits += cells[u].tc->counters[v].hits;
+		}
+		fprintf(out, "  %10.3f ms  %8llu calls  %8llu hits  %s\n", cells[u].time_ns * 1e-6,
+			(unsigned long long)calls, (unsigned long long)hits, cells[u].tc->cell->name);
+	}
+	free(cells);
+}
+
+
+static void
+write_json_string(FILE *out, const char *str) {
+	fputc('"', out);
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\')
+			fprintf(out, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(out, "\\u%04x", *str);
+		else
+			fputc(*str, out);
+	}
+	fputc('"', out);
+}
+
+/**
+ * Write the updates recorded by a library's trace as trace events in the JSON
+ * format understood by Chrome's trace viewer. Each update becomes a complete
+ * event on the thread that ran it, with the cell's name as argument.
+ */
+void
+write_trace_events(phx_library_t *lib, FILE *out) {
+	assert(lib && out);
+	phx_trace_t *trace = phx_library_get_trace(lib);
+	assert(trace);
+
+	fprintf(out, "{\"traceEvents\":[");
+	for (unsigned u = 0; u < trace->events.size; ++u) {
+		phx_trace_event_t *event = array_get(&trace->events, u);
+		fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"update\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cell\":",
+			u > 0 ? "," : "", phx_update_kind_name(event->kind), event->thread,
+			event->start_ns * 1e-3, event->duration_ns * 1e-3);
+		write_json_string(out, event->cell->name);
+		fprintf(out, "}}");
+	}
+	fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+
 int
 phx_net_connects_to(phx_net_t *net, phx_pin_t *pin, phx_inst_t *inst) {
 	assert(net && pin);
@@ -71,7 +367,7 @@ connect(phx_cell_t *cell, phx_pin_t *pin_a, phx_inst_t *inst_a, phx_pin_t *pin_b
 		char buffer[128];
 		static unsigned count = 1;
 		snprintf(buffer, sizeof(buffer), "n%u", count++);
-		net->name = dupstr(buffer);
+		net->name = intern_str(buffer);
 		array_init(&net->conns, sizeof(phx_terminal_t));
 		array_init(&net->arcs, sizeof(phx_timing_arc_t));
 		phx_terminal_t ca = { .pin = pin_a, .inst = inst_a },
@@ -106,14 +402,14 @@ plot_line(cairo_t *cr, mat3_t M, phx_line_t *line, vec2_t *center) {
 
 
 static void
-plot_shape(cairo_t *cr, mat3_t M, phx_shape_t *shape, vec2_t *center) {
-	vec2_t pt = mat3_mul_vec2(M, shape->pts[0]);
+plot_shape(cairo_t *cr, mat3_t M, phx_shape_t *shape, vec2i_t off, vec2_t *center) {
+	vec2_t pt = mat3_mul_vec2(M, VEC2(shape->pts[0].x + off.x, shape->pts[0].y + off.y));
 	vec2_t c = pt;
 	unsigned n = 1;
 
 	cairo_move_to(cr, pt.x, pt.y);
 	for (unsigned u = 1; u < shape->num_pts; ++u) {
-		pt = mat3_mul_vec2(M, shape->pts[u]);
+		pt = mat3_mul_vec2(M, VEC2(shape->pts[u].x + off.x, shape->pts[u].y + off.y));
 		cairo_line_to(cr, pt.x, pt.y);
 		c = vec2_add(c, pt);
 		++n;
@@ -128,10 +424,40 @@ plot_shape(cairo_t *cr, mat3_t M, phx_shape_t *shape, vec2_t *center) {
 
 
 static void
-plot_layer(cairo_t *cr, mat3_t M, phx_layer_t *layer, vec2_t *center) {
+plot_rect(cairo_t *cr, mat3_t M, phx_rect_t rect, vec2_t *center) {
+	vec2_t p0 = mat3_mul_vec2(M, VEC2(rect.min.x, rect.min.y));
+	vec2_t p1 = mat3_mul_vec2(M, VEC2(rect.max.x, rect.max.y));
+	cairo_move_to(cr, p0.x, p0.y);
+	cairo_line_to(cr, p1.x, p0.y);
+	cairo_line_to(cr, p1.x, p1.y);
+	cairo_line_to(cr, p0.x, p1.y);
+	cairo_close_path(cr);
+	if (center)
+		*center = vec2_div(vec2_add(p0, p1), 2);
+}
+
+
+static void
+plot_layer(cairo_t *cr, mat3_t M, phx_layer_t *layer, phx_xform_t *xf, vec2_t *center) {
 	vec2_t c = VEC2(0,0);
 	unsigned n = 0;
 
+	// The geometry is stored in database units, so fold the unit and the
+	// geometry's transformation into the matrix.
+	double dbu = phx_library_get_dbu(phx_layer_get_library(layer));
+	mat3_t X = {{
+		{ xf->xx*dbu, xf->xy*dbu, xf->off.x*dbu },
+		{ xf->yx*dbu, xf->yy*dbu, xf->off.y*dbu },
+		{ 0, 0, 1 },
+	}};
+	mat3_t MX = M;
+	for (unsigned i = 0; i < 2; ++i) {
+		MX.v[i][0] = M.v[i][0]*X.v[0][0] + M.v[i][1]*X.v[1][0];
+		MX.v[i][1] = M.v[i][0]*X.v[0][1] + M.v[i][1]*X.v[1][1];
+		MX.v[i][2] = M.v[i][0]*X.v[0][2] + M.v[i][1]*X.v[1][2] + M.v[i][2];
+	}
+	M = MX;
+
 	for (size_t z = 0, zn = phx_layer_get_num_lines(layer); z < zn; ++z) {
 		phx_line_t *line = phx_layer_get_line(layer, z);
 		vec2_t tc;
@@ -143,7 +469,14 @@ plot_layer(cairo_t *cr, mat3_t M, phx_layer_t *layer, vec2_t *center) {
 	for (size_t z = 0, zn = phx_layer_get_num_shapes(layer); z < zn; ++z) {
 		phx_shape_t *shape = phx_layer_get_shape(layer, z);
 		vec2_t tc;
-		plot_shape(cr, M, shape, &tc);
+		plot_shape(cr, M, shape, phx_layer_get_shape_offset(layer, z), &tc);
+		c = vec2_add(c, tc);
+		++n;
+	}
+
+	for (size_t z = 0, zn = phx_layer_get_num_rects(layer); z < zn; ++z) {
+		vec2_t tc;
+		plot_rect(cr, M, phx_layer_get_rect(layer, z), &tc);
 		c = vec2_add(c, tc);
 		++n;
 	}
@@ -155,6 +488,33 @@ plot_layer(cairo_t *cr, mat3_t M, phx_layer_t *layer, vec2_t *center) {
 }
 
 
+/**
+ * Plot the layers of a pin's geometry, including the shared geometry it
+ * references, and label each layer with the pin's name.
+ */
+static void
+plot_pin_geometry(cairo_t *cr, mat3_t M, phx_geometry_t *geo, phx_xform_t *xf, const char *name) {
+	cairo_text_extents_t extents;
+	for (size_t z = 0, zn = geo->layers.size; z < zn; ++z) {
+		vec2_t c;
+		cairo_set_source_rgb(cr, 1, 0, 0);
+		plot_layer(cr, M, array_get(&geo->layers, z), xf, &c);
+		cairo_stroke(cr);
+
+		cairo_set_source_rgb(cr, 0, 0, 0);
+		cairo_text_extents(cr, name, &extents);
+		cairo_move_to(cr, c.x-extents.width/2, c.y+extents.height/2);
+		cairo_show_text(cr, name);
+		cairo_stroke(cr);
+	}
+	for (unsigned u = 0; u < geo->refs.size; ++u) {
+		phx_geometry_ref_t *ref = array_get(&geo->refs, u);
+		phx_xform_t sub = phx_xform_mul(*xf, ref->xf);
+		plot_pin_geometry(cr, M, &ref->block->geo, &sub, name);
+	}
+}
+
+
 void
 plot_cell_as_pdf(phx_cell_t *cell, const char *filename) {
 	cairo_t *cr;
@@ -270,9 +630,10 @@ plot_cell_as_pdf(phx_cell_t *cell, const char *filename) {
 	// Draw the cell geometry.
 	cairo_set_line_width(cr, 0.5);
 	cairo_save(cr);
+	phx_xform_t identity = phx_xform_identity();
 	for (size_t z = 0, zn = cell->geo.layers.size; z < zn; ++z) {
 		cairo_set_source_rgb(cr, 0.75, 0.75, 0.75);
-		plot_layer(cr, M, array_get(&cell->geo.layers, z), NULL);
+		plot_layer(cr, M, array_get(&cell->geo.layers, z), &identity, NULL);
 		cairo_stroke(cr);
 	}
 	cairo_restore(cr);
@@ -281,19 +642,7 @@ plot_cell_as_pdf(phx_cell_t *cell, const char *filename) {
 	cairo_save(cr);
 	for (size_t z = 0, zn = cell->pins.size; z < zn; ++z) {
 		phx_pin_t *pin = array_at(cell->pins, phx_pin_t*, z);
-		const char *name = pin->name;
-		for (size_t z = 0, zn = pin->geo.layers.size; z < zn; ++z) {
-			vec2_t c;
-			cairo_set_source_rgb(cr, 1, 0, 0);
-			plot_layer(cr, M, array_get(&pin->geo.layers, z), &c);
-			cairo_stroke(cr);
-
-			cairo_set_source_rgb(cr, 0, 0, 0);
-			cairo_text_extents(cr, name, &extents);
-			cairo_move_to(cr, c.x-extents.width/2, c.y+extents.height/2);
-			cairo_show_text(cr, name);
-			cairo_stroke(cr);
-		}
+		plot_pin_geometry(cr, M, &pin->geo, &identity, pin->name);
 	}
 	cairo_restore(cr);
 
@@ -302,8 +651,12 @@ plot_cell_as_pdf(phx_cell_t *cell, const char *filename) {
 }
 
 
+/**
+ * Load the macros of a LEF file into a library. If @a filter is not `NULL`,
+ * geometry on layers rejected by the filter is skipped.
+ */
 void
-load_lef(phx_library_t *into, lef_t *lef, phx_tech_t *tech) {
+load_lef(phx_library_t *into, lef_t *lef, phx_tech_t *tech, phx_tech_filter_t *filter) {
 	for (size_t z = 0, zn = lef_get_num_macros(lef); z < zn; ++z) {
 		lef_macro_t *macro = lef_get_macro(lef,z);
 		phx_cell_t *cell = phx_library_find_cell(into, lef_macro_get_name(macro), true);
@@ -323,7 +676,13 @@ load_lef(phx_library_t *into, lef_t *lef, phx_tech_t *tech) {
 					if (geo->kind == LEF_GEO_LAYER) {
 						lef_geo_layer_t *src_layer = (void*)geo;
 						const char *layer_name = lef_geo_layer_get_name(src_layer);
-						phx_tech_layer_t *tech_layer = phx_tech_find_layer_name(tech, layer_name, true);
+						phx_tech_layer_t *tech_layer = phx_tech_find_layer_name(tech, layer_name, !filter);
+						if (filter) {
+							if (!phx_tech_filter_accepts(filter, tech_layer))
+								continue;
+							if (!tech_layer)
+								tech_layer = phx_tech_find_layer_name(tech, layer_name, true);
+						}
 						phx_layer_t *dst_layer = phx_geometry_on_layer(dst_geo, tech_layer);
 
 						for (size_t v = 0, vn = lef_geo_layer_get_num_shapes(src_layer); v < vn; ++v) {
@@ -339,12 +698,7 @@ load_lef(phx_library_t *into, lef_t *lef, phx_tech_t *tech) {
 							/// @todo Use lef_geo_shape_get_kind(shape)
 							switch (shape->kind) {
 								case LEF_SHAPE_RECT:
-									phx_layer_add_shape(dst_layer, 4, (vec2_t[]){
-										{ scaled[0].x, scaled[0].y },
-										{ scaled[1].x, scaled[0].y },
-										{ scaled[1].x, scaled[1].y },
-										{ scaled[0].x, scaled[1].y },
-									});
+									phx_layer_add_rect(dst_layer, scaled[0], scaled[1]);
 									break;
 								case LEF_SHAPE_POLYGON:
 									phx_layer_add_shape(dst_layer, num_points, scaled);
@@ -453,9 +807,17 @@ load_lib(phx_library_t *into, lib_t *lib, phx_tech_t *tech) {
 }
 
 
+/**
+ * Load the structures of a GDS library into a library. If @a filter is not
+ * `NULL`, elements on layers rejected by the filter are skipped. The cells
+ * still reference the complete GDS structures for pass-through export.
+ */
 void
-load_gds(phx_library_t *into, gds_lib_t *lib, phx_tech_t *tech) {
-	double unit = gds_lib_get_units(lib).dbu_in_m;
+load_gds(phx_library_t *into, gds_lib_t *lib, phx_tech_t *tech, phx_tech_filter_t *filter) {
+	// If the GDS file uses the same database unit as the library, coordinates
+	// are copied verbatim. Otherwise they are rescaled and rounded.
+	double unit = gds_lib_get_units(lib).dbu_in_m / phx_library_get_dbu(into);
+	bool same_unit = fabs(unit - 1) < 1e-9;
 
 	for (size_t z = 0, zn = gds_lib_get_num_structs(lib); z < zn; ++z) {
 		gds_struct_t *str = gds_lib_get_struct(lib, z);
@@ -470,31 +832,40 @@ load_gds(phx_library_t *into, gds_lib_t *lib, phx_tech_t *tech) {
 			gds_xy_t *xy = gds_elem_get_xy(elem);
 			uint16_t num_xy = gds_elem_get_num_xy(elem);
 
-			phx_tech_layer_t *tech_layer = phx_tech_find_layer_id(tech, (uint32_t)layer_id << 16 | type_id, true);
+			uint32_t id = (uint32_t)layer_id << 16 | type_id;
+			phx_tech_layer_t *tech_layer = phx_tech_find_layer_id(tech, id, !filter);
+			if (filter) {
+				if (!phx_tech_filter_accepts(filter, tech_layer))
+					continue;
+				if (!tech_layer)
+					tech_layer = phx_tech_find_layer_id(tech, id, true);
+			}
 			phx_layer_t *layer = phx_geometry_on_layer(&cell->geo, tech_layer);
-			vec2_t *pts;
-			size_t num_pts = 0;
-
-			switch (gds_elem_get_kind(elem)) {
-				case GDS_ELEM_BOUNDARY: {
-					num_pts = num_xy - 1;
-					phx_shape_t *shape = phx_layer_add_shape(layer, num_pts, NULL);
-					pts = shape->pts;
-					break;
+			int kind = gds_elem_get_kind(elem);
+			if (kind != GDS_ELEM_BOUNDARY && kind != GDS_ELEM_PATH)
+				continue;
+
+			// Convert the points to the library's database units. The last
+			// point of a boundary repeats the first and is dropped.
+			size_t num_pts = (kind == GDS_ELEM_BOUNDARY ? num_xy - 1 : num_xy);
+			vec2i_t pts[num_pts];
+			if (same_unit) {
+				for (uint16_t u = 0; u < num_pts; ++u) {
+					pts[u].x = xy[u].x;
+					pts[u].y = xy[u].y;
 				}
-				case GDS_ELEM_PATH: {
-					/// @todo Use the element's width instead of 100nm.
-					num_pts = num_xy;
-					phx_line_t *line = phx_layer_add_line(layer, 0.1e-6, num_pts, NULL);
-					pts = line->pts;
-					break;
+			} else {
+				for (uint16_t u = 0; u < num_pts; ++u) {
+					pts[u].x = lround(xy[u].x * unit);
+					pts[u].y = lround(xy[u].y * unit);
 				}
 			}
 
-			// Convert the points to local units.
-			for (uint16_t u = 0; u < num_pts; ++u) {
-				pts[u].x = xy[u].x * unit;
-				pts[u].y = xy[u].y * unit;
+			if (kind == GDS_ELEM_BOUNDARY) {
+				phx_layer_add_shape_dbu(layer, num_pts, pts);
+			} else {
+				/// @todo Use the element's width instead of 100nm.
+				phx_layer_add_line_dbu(layer, phx_library_to_dbu(into, 0.1e-6), num_pts, pts);
 			}
 		}
 	}
@@ -579,6 +950,11 @@ cell_to_gds(phx_cell_t *cell, gds_lib_t *target) {
 	double unit = 1.0/gds_lib_get_units(target).dbu_in_m;
 	gds_struct_t *str = gds_struct_create(cell->name);
 
+	// Geometry is emitted verbatim if the target uses the library's database
+	// unit, and rescaled otherwise.
+	double geo_unit = phx_library_get_dbu(cell->lib) * unit;
+	bool same_unit = fabs(geo_unit - 1) < 1e-9;
+
 	for (unsigned u = 0; u < cell->geo.layers.size; ++u) {
 		phx_layer_t *layer = array_get(&cell->geo.layers, u);
 		uint16_t layer_id = layer->tech->id >> 16;
@@ -589,9 +965,8 @@ cell_to_gds(phx_cell_t *cell, gds_lib_t *target) {
 			phx_line_t *line = phx_layer_get_line(layer, z);
 			gds_xy_t xy[line->num_pts];
 			for (uint16_t u = 0; u < line->num_pts; ++u) {
-				xy[u].x = line->pts[u].x * unit + 0.5;
-				xy[u].y = line->pts[u].y * unit + 0.5;
-				// Adding 0.5 ensures the coordinates are rounded to dbu properly.
+				xy[u].x = same_unit ? line->pts[u].x : lround(line->pts[u].x * geo_unit);
+				xy[u].y = same_unit ? line->pts[u].y : lround(line->pts[u].y * geo_unit);
 			}
 			gds_elem_t *elem = gds_elem_create_path(layer_id, type_id, line->num_pts, xy);
 			gds_struct_add_elem(str, elem);
@@ -600,16 +975,37 @@ cell_to_gds(phx_cell_t *cell, gds_lib_t *target) {
 		// Shapes
 		for (size_t z = 0, zn = phx_layer_get_num_shapes(layer); z < zn; ++z) {
 			phx_shape_t *shape = phx_layer_get_shape(layer, z);
+			vec2i_t off = phx_layer_get_shape_offset(layer, z);
 			gds_xy_t xy[shape->num_pts+1];
 			for (uint16_t u = 0; u < shape->num_pts; ++u) {
-				xy[u].x = shape->pts[u].x * unit + 0.5;
-				xy[u].y = shape->pts[u].y * unit + 0.5;
-				// Adding 0.5 ensures the coordinates are rounded to dbu properly.
+				int32_t x = shape->pts[u].x + off.x, y = shape->pts[u].y + off.y;
+				xy[u].x = same_unit ? x : lround(x * geo_unit);
+				xy[u].y = same_unit ? y : lround(y * geo_unit);
 			}
 			xy[shape->num_pts] = xy[0];
 			gds_elem_t *elem = gds_elem_create_boundary(layer_id, type_id, shape->num_pts+1, xy);
 			gds_struct_add_elem(str, elem);
 		}
+
+		// Rectangles
+		for (size_t z = 0, zn = phx_layer_get_num_rects(layer); z < zn; ++z) {
+			phx_rect_t r = phx_layer_get_rect(layer, z);
+			if (!same_unit) {
+				r.min.x = lround(r.min.x * geo_unit);
+				r.min.y = lround(r.min.y * geo_unit);
+				r.max.x = lround(r.max.x * geo_unit);
+				r.max.y = lround(r.max.y * geo_unit);
+			}
+			gds_xy_t xy[5] = {
+				{ r.min.x, r.min.y },
+				{ r.max.x, r.min.y },
+				{ r.max.x, r.max.y },
+				{ r.min.x, r.max.y },
+				{ r.min.x, r.min.y },
+			};
+			gds_elem_t *elem = gds_elem_create_boundary(layer_id, type_id, 5, xy);
+			gds_struct_add_elem(str, elem);
+		}
 	}
 
 	// Additional GDS text.
@@ -7,14 +7,19 @@
 void dump_cell_nets(phx_cell_t *cell, FILE *out);
 void dump_timing_arcs(phx_cell_t *cell);
 
-void load_lef(phx_library_t *into, lef_t *lef, phx_tech_t *tech);
+void load_lef(phx_library_t *into, lef_t *lef, phx_tech_t *tech, phx_tech_filter_t *filter);
 void load_lib(phx_library_t *into, lib_t *lib, phx_tech_t *tech);
-void load_gds(phx_library_t *into, gds_lib_t *lib, phx_tech_t *tech);
+void load_gds(phx_library_t *into, gds_lib_t *lib, phx_tech_t *tech, phx_tech_filter_t *filter);
 void load_tech_layer_map(phx_tech_t *tech, const char *filename);
 void plot_cell_as_pdf(phx_cell_t *cell, const char *filename);
 void dump_cell_nets(phx_cell_t *cell, FILE *out);
 int phx_net_connects_to(phx_net_t *net, phx_pin_t *pin, phx_inst_t *inst);
 void connect(phx_cell_t *cell, phx_pin_t *pin_a, phx_inst_t *inst_a, phx_pin_t *pin_b, phx_inst_t *inst_b);
+unsigned check_connectivity(phx_cell_t *cell, FILE *out);
+unsigned check_spacing(phx_cell_t *cell, FILE *out);
+void report_memory(phx_library_t *lib, FILE *out, unsigned max_cells);
+void report_trace(phx_library_t *lib, FILE *out, unsigned max_cells);
+void write_trace_events(phx_library_t *lib, FILE *out);
 gds_struct_t *cell_to_gds(phx_cell_t *cell, gds_lib_t *target);
 
 enum route_dir {
@@ -6,6 +6,9 @@ phx_tech_t *
 phx_tech_create() {
 	phx_tech_t *tech = calloc(1, sizeof(*tech));
 	ptrset_init(&tech->layers);
+	strmap_init(&tech->layers_by_name);
+	intmap_init(&tech->layers_by_id);
+	array_init(&tech->vias, sizeof(phx_tech_via_t));
 	return tech;
 }
 
@@ -14,6 +17,9 @@ void
 phx_tech_destroy(phx_tech_t *tech) {
 	assert(tech);
 	ptrset_dispose(&tech->layers);
+	strmap_dispose(&tech->layers_by_name);
+	intmap_dispose(&tech->layers_by_id);
+	array_dispose(&tech->vias);
 	free(tech);
 }
 
@@ -22,14 +28,12 @@ phx_tech_layer_t *
 phx_tech_find_layer_id(phx_tech_t *tech, uint32_t id, bool create) {
 	phx_tech_layer_t *layer;
 	assert(tech);
-	for (size_t z = 0; z < tech->layers.size; ++z) {
-		layer = tech->layers.items[z];
-		if (layer->id == id)
-			return layer;
-	}
+	layer = intmap_get(&tech->layers_by_id, id);
+	if (layer)
+		return layer;
 	if (create) {
 		layer = phx_tech_layer_create(tech);
-		layer->id = id;
+		phx_tech_layer_set_id(layer, id);
 		return layer;
 	} else {
 		return NULL;
@@ -40,15 +44,13 @@ phx_tech_find_layer_id(phx_tech_t *tech, uint32_t id, bool create) {
 phx_tech_layer_t *
 phx_tech_find_layer_name(phx_tech_t *tech, const char *name, bool create) {
 	phx_tech_layer_t *layer;
-	assert(tech);
-	for (size_t z = 0; z < tech->layers.size; ++z) {
-		layer = tech->layers.items[z];
-		if (strcmp(layer->name, name) == 0)
-			return layer;
-	}
+	assert(tech && name);
+	layer = strmap_get(&tech->layers_by_name, name);
+	if (layer)
+		return layer;
 	if (create) {
 		layer = phx_tech_layer_create(tech);
-		layer->name = dupstr(name);
+		phx_tech_layer_set_name(layer, name);
 		return layer;
 	} else {
 		return NULL;
@@ -56,11 +58,95 @@ phx_tech_find_layer_name(phx_tech_t *tech, const char *name, bool create) {
 }
 
 
+/**
+ * Declare that geometry on the layer @a cut connects the geometry it overlaps
+ * on the layers @a below and @a above.
+ */
+void
+phx_tech_add_via(phx_tech_t *tech, phx_tech_layer_t *cut, phx_tech_layer_t *below, phx_tech_layer_t *above) {
+	assert(tech && cut && below && above);
+	phx_tech_via_t via = { cut, below, above };
+	array_add(&tech->vias, &via);
+}
+
+
+unsigned
+phx_tech_get_num_vias(phx_tech_t *tech) {
+	assert(tech);
+	return tech->vias.size;
+}
+
+
+phx_tech_via_t *
+phx_tech_get_via(phx_tech_t *tech, unsigned idx) {
+	assert(tech && idx < tech->vias.size);
+	return array_get(&tech->vias, idx);
+}
+
+
+/**
+ * Get the number of layer indices handed out so far. All layers of the
+ * technology have an index below this number.
+ */
+unsigned
+phx_tech_get_num_layer_indices(phx_tech_t *tech) {
+	assert(tech);
+	return tech->num_layer_indices;
+}
+
+
+/**
+ * Remove a layer from the table of layers by name. If another layer has the
+ * same name, it takes the removed layer's place.
+ */
+static void
+unindex_name(phx_tech_layer_t *layer) {
+	phx_tech_t *tech = layer->tech;
+	if (!layer->name || strmap_get(&tech->layers_by_name, layer->name) != layer)
+		return;
+	strmap_remove(&tech->layers_by_name, layer->name);
+	if (tech->num_shadowed == 0)
+		return;
+	for (size_t z = 0; z < tech->layers.size; ++z) {
+		phx_tech_layer_t *other = tech->layers.items[z];
+		if (other != layer && other->name && strcmp(other->name, layer->name) == 0) {
+			strmap_add(&tech->layers_by_name, other->name, other);
+			--tech->num_shadowed;
+			return;
+		}
+	}
+}
+
+
+/**
+ * Remove a layer from the table of layers by ID. If another layer has the same
+ * ID, it takes the removed layer's place.
+ */
+static void
+unindex_id(phx_tech_layer_t *layer) {
+	phx_tech_t *tech = layer->tech;
+	if (!layer->has_id || intmap_get(&tech->layers_by_id, layer->id) != layer)
+		return;
+	intmap_remove(&tech->layers_by_id, layer->id);
+	if (tech->num_shadowed == 0)
+		return;
+	for (size_t z = 0; z < tech->layers.size; ++z) {
+		phx_tech_layer_t *other = tech->layers.items[z];
+		if (other != layer && other->has_id && other->id == layer->id) {
+			intmap_add(&tech->layers_by_id, other->id, other);
+			--tech->num_shadowed;
+			return;
+		}
+	}
+}
+
+
 phx_tech_layer_t *
 phx_tech_layer_create(phx_tech_t *tech) {
 	assert(tech);
 	phx_tech_layer_t *layer = calloc(1, sizeof(*layer));
 	layer->tech = tech;
+	layer->index = tech->num_layer_indices++;
 	ptrset_add(&tech->layers, layer);
 	return layer;
 }
@@ -69,8 +155,9 @@ phx_tech_layer_create(phx_tech_t *tech) {
 void
 phx_tech_layer_destroy(phx_tech_layer_t *layer) {
 	assert(layer);
+	unindex_name(layer);
+	unindex_id(layer);
 	ptrset_remove(&layer->tech->layers, layer);
-	if (layer->name) free(layer->name);
 	free(layer);
 }
 
@@ -78,16 +165,21 @@ phx_tech_layer_destroy(phx_tech_layer_t *layer) {
 void
 phx_tech_layer_set_id(phx_tech_layer_t *layer, uint32_t id) {
 	assert(layer);
+	unindex_id(layer);
 	layer->id = id;
+	layer->has_id = true;
+	if (!intmap_add(&layer->tech->layers_by_id, id, layer))
+		++layer->tech->num_shadowed;
 }
 
 
 void
 phx_tech_layer_set_name(phx_tech_layer_t *layer, const char *name) {
 	assert(layer && name);
-	if (layer->name)
-		free(layer->name);
-	layer->name = dupstr(name);
+	unindex_name(layer);
+	layer->name = intern_str(name);
+	if (!strmap_add(&layer->tech->layers_by_name, layer->name, layer))
+		++layer->tech->num_shadowed;
 }
 
 
@@ -98,8 +190,95 @@ phx_tech_layer_get_id(phx_tech_layer_t *layer) {
 }
 
 
+unsigned
+phx_tech_layer_get_index(phx_tech_layer_t *layer) {
+	assert(layer);
+	return layer->index;
+}
+
+
 const char *
 phx_tech_layer_get_name(phx_tech_layer_t *layer) {
 	assert(layer);
 	return layer->name;
 }
+
+
+void
+phx_tech_layer_set_min_width(phx_tech_layer_t *layer, double width) {
+	assert(layer && width >= 0);
+	layer->min_width = width;
+}
+
+
+void
+phx_tech_layer_set_min_spacing(phx_tech_layer_t *layer, double spacing) {
+	assert(layer && spacing >= 0);
+	layer->min_spacing = spacing;
+}
+
+
+double
+phx_tech_layer_get_min_width(phx_tech_layer_t *layer) {
+	assert(layer);
+	return layer->min_width;
+}
+
+
+double
+phx_tech_layer_get_min_spacing(phx_tech_layer_t *layer) {
+	assert(layer);
+	return layer->min_spacing;
+}
+
+
+void
+phx_tech_filter_init(phx_tech_filter_t *filter) {
+	assert(filter);
+	ptrset_init(&filter->allow);
+	ptrset_init(&filter->deny);
+}
+
+
+void
+phx_tech_filter_dispose(phx_tech_filter_t *filter) {
+	assert(filter);
+	ptrset_dispose(&filter->allow);
+	ptrset_dispose(&filter->deny);
+}
+
+
+/**
+ * Add a layer to the filter's allow list. As soon as one layer is allowed, all
+ * layers not on the allow list are rejected.
+ */
+void
+phx_tech_filter_allow(phx_tech_filter_t *filter, phx_tech_layer_t *layer) {
+	assert(filter && layer);
+	ptrset_add(&filter->allow, layer);
+}
+
+
+/**
+ * Add a layer to the filter's deny list.
+ */
+void
+phx_tech_filter_deny(phx_tech_filter_t *filter, phx_tech_layer_t *layer) {
+	assert(filter && layer);
+	ptrset_add(&filter->deny, layer);
+}
+
+
+/**
+ * Check whether a filter accepts a layer. The layer may be `NULL` to check
+ * whether a layer unknown to the technology would be accepted.
+ */
+bool
+phx_tech_filter_accepts(phx_tech_filter_t *filter, phx_tech_layer_t *layer) {
+	assert(filter);
+	if (!layer)
+		return filter->allow.size == 0;
+	if (filter->allow.size > 0 && !ptrset_contains(&filter->allow, layer))
+		return false;
+	return !ptrset_contains(&filter->deny, layer);
+}
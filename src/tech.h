@@ -6,17 +6,64 @@
 
 struct phx_tech {
 	ptrset_t layers; /* phx_tech_layer_t* */
+	/// The layers by name and by GDS ID. If several layers share a name or
+	/// ID, only one of them is found.
+	strmap_t layers_by_name; /* phx_tech_layer_t* */
+	intmap_t layers_by_id; /* phx_tech_layer_t* */
+	/// An upper bound on the number of layers missing from the above tables
+	/// because another layer has the same name or ID.
+	unsigned num_shadowed;
+	/// The number of layer indices handed out so far. Indices are never
+	/// reused, such that tables indexed by them remain valid.
+	unsigned num_layer_indices;
+	/// The vias that connect layers. See phx_tech_add_via.
+	array_t vias; /* phx_tech_via_t */
 };
 
 struct phx_tech_layer {
 	/// The technology this layer belongs to.
 	phx_tech_t *tech;
-	/// The layer's name.
-	char *name;
-	/// The layer ID used in GDS files.
+	/// The layer's name, interned. See intern_str.
+	const char *name;
+	/// The layer ID used in GDS files, composed of the GDS layer and data type
+	/// as `layer << 16 | type`. Only valid if @a has_id is set.
 	uint32_t id;
+	bool has_id;
+	/// A small integer that identifies the layer within the technology,
+	/// assigned upon creation. Used to look up layers through tables.
+	unsigned index;
 	/// The layer's color when plotting.
 	double color[3];
+	/// The minimum width of geometry on this layer, in meters. Zero if the
+	/// width is not checked.
+	double min_width;
+	/// The minimum distance between separate pieces of geometry on this
+	/// layer, in meters. Zero if the spacing is not checked.
+	double min_spacing;
+};
+
+/**
+ * A rule stating that geometry on a cut layer electrically connects the
+ * geometry it overlaps on the layers below and above.
+ */
+struct phx_tech_via {
+	/// The cut layer.
+	phx_tech_layer_t *cut;
+	/// The layers connected by the cut.
+	phx_tech_layer_t *below;
+	phx_tech_layer_t *above;
+};
+
+/**
+ * A selection of technology layers, used to restrict which layers are loaded
+ * from a file. A layer is accepted if it is not denied and, if any layers
+ * have been explicitly allowed, is among them.
+ */
+struct phx_tech_filter {
+	/// The layers that are accepted. Empty if all layers are accepted.
+	ptrset_t allow; /* phx_tech_layer_t* */
+	/// The layers that are rejected.
+	ptrset_t deny; /* phx_tech_layer_t* */
 };
 
 
@@ -24,10 +71,25 @@ phx_tech_t *phx_tech_create();
 void phx_tech_destroy(phx_tech_t*);
 phx_tech_layer_t *phx_tech_find_layer_id(phx_tech_t*, uint32_t, bool);
 phx_tech_layer_t *phx_tech_find_layer_name(phx_tech_t*, const char*, bool);
+void phx_tech_add_via(phx_tech_t*, phx_tech_layer_t*, phx_tech_layer_t*, phx_tech_layer_t*);
+unsigned phx_tech_get_num_vias(phx_tech_t*);
+phx_tech_via_t *phx_tech_get_via(phx_tech_t*, unsigned);
+unsigned phx_tech_get_num_layer_indices(phx_tech_t*);
 
 phx_tech_layer_t *phx_tech_layer_create(phx_tech_t*);
 void phx_tech_layer_destroy(phx_tech_layer_t*);
 void phx_tech_layer_set_id(phx_tech_layer_t*, uint32_t);
 void phx_tech_layer_set_name(phx_tech_layer_t*, const char*);
 uint32_t phx_tech_layer_get_id(phx_tech_layer_t*);
+unsigned phx_tech_layer_get_index(phx_tech_layer_t*);
 const char *phx_tech_layer_get_name(phx_tech_layer_t*);
+void phx_tech_layer_set_min_width(phx_tech_layer_t*, double);
+void phx_tech_layer_set_min_spacing(phx_tech_layer_t*, double);
+double phx_tech_layer_get_min_width(phx_tech_layer_t*);
+double phx_tech_layer_get_min_spacing(phx_tech_layer_t*);
+
+void phx_tech_filter_init(phx_tech_filter_t*);
+void phx_tech_filter_dispose(phx_tech_filter_t*);
+void phx_tech_filter_allow(phx_tech_filter_t*, phx_tech_layer_t*);
+void phx_tech_filter_deny(phx_tech_filter_t*, phx_tech_layer_t*);
+bool phx_tech_filter_accepts(phx_tech_filter_t*, phx_tech_layer_t*);
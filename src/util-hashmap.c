@@ -0,0 +1,235 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#include "common.h"
+#include "util.h"
+
+
+static uint32_t
+hash_string(const char *str) {
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	for (; *str; ++str)
+		h = (h ^ (uint8_t)*str) * 16777619u;
+	return h;
+}
+
+
+static uint32_t
+hash_int(uint32_t key) {
+	// Finalizer of MurmurHash3, such that nearby keys spread across the table.
+	key ^= key >> 16;
+	key *= 0x85ebca6bu;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35u;
+	key ^= key >> 16;
+	return key;
+}
+
+
+void
+strmap_init(strmap_t *map) {
+	assert(map);
+	memset(map, 0, sizeof(*map));
+}
+
+
+void
+strmap_dispose(strmap_t *map) {
+	assert(map);
+	if (map->slots)
+		free(map->slots);
+	memset(map, 0, sizeof(*map));
+}
+
+
+static strmap_slot_t *
+strmap_locate(strmap_t *map, const char *key, uint32_t hash) {
+	size_t mask = map->capacity - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		strmap_slot_t *slot = map->slots + i;
+		if (!slot->key || slot->key == key || (slot->hash == hash && strcmp(slot->key, key) == 0))
+			return slot;
+	}
+}
+
+
+/**
+ * Look up the value associated with a key.
+ *
+ * @return The value, or `NULL` if the key is not in the map.
+ */
+void *
+strmap_get(strmap_t *map, const char *key) {
+	assert(map && key);
+	if (map->size == 0)
+		return NULL;
+	strmap_slot_t *slot = strmap_locate(map, key, hash_string(key));
+	return slot->key ? slot->value : NULL;
+}
+
+
+/**
+ * Associate a value with a key, unless the key is already in the map.
+ *
+ * @return `true` if the key was added, `false` if it already existed.
+ */
+bool
+strmap_add(strmap_t *map, const char *key, void *value) {
+	assert(map && key && value);
+
+	// Keep the map at most half full.
+	if (2 * (map->size + 1) > map->capacity) {
+		strmap_t grown = { map->size, map->capacity ? map->capacity * 2 : 16, NULL };
+		grown.slots = calloc(grown.capacity, sizeof(strmap_slot_t));
+		for (size_t z = 0; z < map->capacity; ++z)
+			if (map->slots[z].key)
+				*strmap_locate(&grown, map->slots[z].key, map->slots[z].hash) = map->slots[z];
+		if (map->slots)
+			free(map->slots);
+		*map = grown;
+	}
+
+	uint32_t hash = hash_string(key);
+	strmap_slot_t *slot = strmap_locate(map, key, hash);
+	if (slot->key)
+		return false;
+	*slot = (strmap_slot_t){ hash, key, value };
+	++map->size;
+	return true;
+}
+
+
+/**
+ * Remove a key from the map.
+ *
+ * @return The value that was associated with the key, or `NULL` if the key
+ * was not in the map.
+ */
+void *
+strmap_remove(strmap_t *map, const char *key) {
+	assert(map && key);
+	if (map->size == 0)
+		return NULL;
+	strmap_slot_t *slot = strmap_locate(map, key, hash_string(key));
+	if (!slot->key)
+		return NULL;
+	void *value = slot->value;
+
+	// Shift subsequent entries of the probe sequence into the hole, such that
+	// lookups never stop early at an empty slot.
+	size_t mask = map->capacity - 1;
+	size_t i = slot - map->slots;
+	for (size_t j = (i + 1) & mask; map->slots[j].key; j = (j + 1) & mask) {
+		size_t home = map->slots[j].hash & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			map->slots[i] = map->slots[j];
+			i = j;
+		}
+	}
+	map->slots[i].key = NULL;
+	--map->size;
+	return value;
+}
+
+
+void
+intmap_init(intmap_t *map) {
+	assert(map);
+	memset(map, 0, sizeof(*map));
+}
+
+
+void
+intmap_dispose(intmap_t *map) {
+	assert(map);
+	if (map->slots)
+		free(map->slots);
+	memset(map, 0, sizeof(*map));
+}
+
+
+static intmap_slot_t *
+intmap_locate(intmap_t *map, uint32_t key) {
+	size_t mask = map->capacity - 1;
+	for (size_t i = hash_int(key) & mask;; i = (i + 1) & mask) {
+		intmap_slot_t *slot = map->slots + i;
+		if (!slot->value || slot->key == key)
+			return slot;
+	}
+}
+
+
+/**
+ * Look up the value associated with a key.
+ *
+ * @return The value, or `NULL` if the key is not in the map.
+ */
+void *
+intmap_get(intmap_t *map, uint32_t key) {
+	assert(map);
+	if (map->size == 0)
+		return NULL;
+	return intmap_locate(map, key)->value;
+}
+
+
+/**
+ * Associate a value with a key, unless the key is already in the map.
+ *
+ * @return `true` if the key was added, `false` if it already existed.
+ */
+bool
+intmap_add(intmap_t *map, uint32_t key, void *value) {
+	assert(map && value);
+
+	// Keep the map at most half full.
+	if (2 * (map->size + 1) > map->capacity) {
+		intmap_t grown = { map->size, map->capacity ? map->capacity * 2 : 16, NULL };
+		grown.slots = calloc(grown.capacity, sizeof(intmap_slot_t));
+		for (size_t z = 0; z < map->capacity; ++z)
+			if (map->slots[z].value)
+				*intmap_locate(&grown, map->slots[z].key) = map->slots[z];
+		if (map->slots)
+			free(map->slots);
+		*map = grown;
+	}
+
+	intmap_slot_t *slot = intmap_locate(map, key);
+	if (slot->value)
+		return false;
+	*slot = (intmap_slot_t){ key, value };
+	++map->size;
+	return true;
+}
+
+
+/**
+ * Remove a key from the map.
+ *
+ * @return The value that was associated with the key, or `NULL` if the key
+ * was not in the map.
+ */
+void *
+intmap_remove(intmap_t *map, uint32_t key) {
+	assert(map);
+	if (map->size == 0)
+		return NULL;
+	intmap_slot_t *slot = intmap_locate(map, key);
+	if (!slot->value)
+		return NULL;
+	void *value = slot->value;
+
+	// Shift subsequent entries of the probe sequence into the hole, such that
+	// lookups never stop early at an empty slot.
+	size_t mask = map->capacity - 1;
+	size_t i = slot - map->slots;
+	for (size_t j = (i + 1) & mask; map->slots[j].value; j = (j + 1) & mask) {
+		size_t home = hash_int(map->slots[j].key) & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			map->slots[i] = map->slots[j];
+			i = j;
+		}
+	}
+	map->slots[i].value = NULL;
+	--map->size;
+	return value;
+}
@@ -0,0 +1,150 @@
+/* Copyright (c) 2016 Fabian Schuiki */
+#include "util.h"
+
+/**
+ * @file
+ *
+ * This file implements a memory pool that allocates objects from slabs.
+ */
+
+
+static size_t
+pool_round(size_t size) {
+	return (size + POOL_GRANULE - 1) / POOL_GRANULE * POOL_GRANULE;
+}
+
+
+/**
+ * Allocates a new slab of the next slab size and makes it the current slab.
+ */
+static void
+pool_add_slab(pool_t *pool) {
+	assert(pool);
+	size_t size = pool->next_size;
+	if (pool->next_size < POOL_MAX_SLAB)
+		pool->next_size *= 2;
+
+	pool_slab_t *slab = malloc(sizeof(*slab) + size);
+	slab->next = pool->slabs;
+	slab->size = size;
+	pool->slabs = slab;
+	pool->ptr = (char*)(slab + 1);
+	pool->end = pool->ptr + size;
+}
+
+
+/**
+ * Allocates an object that is larger than the next slab in a slab of its own.
+ * The current slab and the size of later slabs are left untouched.
+ */
+static void *
+pool_alloc_large(pool_t *pool, size_t size) {
+	assert(pool);
+	pool_slab_t *slab = malloc(sizeof(*slab) + size);
+	slab->size = size;
+	if (pool->slabs) {
+		slab->next = pool->slabs->next;
+		pool->slabs->next = slab;
+	} else {
+		slab->next = NULL;
+		pool->slabs = slab;
+	}
+	return slab + 1;
+}
+
+
+/**
+ * Initializes a pool.
+ */
+void
+pool_init(pool_t *pool) {
+	assert(pool);
+	memset(pool, 0, sizeof(*pool));
+	pool->next_size = POOL_MIN_SLAB;
+}
+
+
+/**
+ * Releases all memory held by a pool, including all objects allocated from
+ * it.
+ */
+void
+pool_dispose(pool_t *pool) {
+	assert(pool);
+	pool_slab_t *slab = pool->slabs;
+	while (slab) {
+		pool_slab_t *next = slab->next;
+		free(slab);
+		slab = next;
+	}
+	pool_init(pool);
+}
+
+
+/**
+ * Get the number of bytes a pool holds, including unused and freed space.
+ */
+size_t
+pool_get_size(pool_t *pool) {
+	assert(pool);
+	size_t size = 0;
+	for (pool_slab_t *slab = pool->slabs; slab; slab = slab->next)
+		size += sizeof(*slab) + slab->size;
+	return size;
+}
+
+
+/**
+ * Allocates an object of the given size from the pool. The memory is
+ * uninitialized.
+ */
+void *
+pool_alloc(pool_t *pool, size_t size) {
+	assert(pool && size > 0);
+	size = pool_round(size);
+
+	// Reuse a previously freed object of the same size class if possible.
+	size_t cls = size / POOL_GRANULE - 1;
+	if (cls < POOL_NUM_CLASSES && pool->free[cls]) {
+		void *ptr = pool->free[cls];
+		pool->free[cls] = *(void**)ptr;
+		return ptr;
+	}
+
+	if ((size_t)(pool->end - pool->ptr) < size) {
+		if (size > pool->next_size)
+			return pool_alloc_large(pool, size);
+		pool_add_slab(pool);
+	}
+	void *ptr = pool->ptr;
+	pool->ptr += size;
+	return ptr;
+}
+
+
+/**
+ * Allocates a zero-initialized object of the given size from the pool.
+ */
+void *
+pool_calloc(pool_t *pool, size_t size) {
+	void *ptr = pool_alloc(pool, size);
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+
+/**
+ * Returns an object to the pool. The @a size must be the same as when the
+ * object was allocated. The object's memory is reused by later allocations of
+ * the same size, but is only released to the system once the pool is
+ * disposed.
+ */
+void
+pool_free(pool_t *pool, void *ptr, size_t size) {
+	assert(pool && ptr);
+	size_t cls = pool_round(size) / POOL_GRANULE - 1;
+	if (cls < POOL_NUM_CLASSES) {
+		*(void**)ptr = pool->free[cls];
+		pool->free[cls] = ptr;
+	}
+}
@@ -114,3 +114,18 @@ ptrset_contains(ptrset_t *set, void *ptr) {
 	assert(set && ptr);
 	return locate(set, ptr, NULL) != NULL;
 }
+
+
+/**
+ * Find the position of a pointer in a pointer set. Positions range from 0 to
+ * the size of the set and follow the order of the pointers, such that they
+ * remain valid as long as the set is not modified.
+ *
+ * @return `true` if the pointer was found and its position stored in @a pos,
+ * `false` otherwise.
+ */
+bool
+ptrset_find(ptrset_t *set, void *ptr, size_t *pos) {
+	assert(set && ptr && pos);
+	return locate(set, ptr, pos) != NULL;
+}
@@ -29,6 +29,43 @@ dupmem(const void *src, size_t len) {
 }
 
 
+/* The interned strings. The pool is initialized upon first use. */
+static strmap_t interned_strings;
+static pool_t interned_pool;
+
+
+/**
+ * Get the unique copy of a string. All strings passed to this function that
+ * are equal share one copy, such that two interned strings are equal if and
+ * only if they are the same pointer. The copies live until the program ends.
+ * Not safe to call from multiple threads at the same time.
+ *
+ * @return The interned copy of @a str, or `NULL` if @a str is `NULL`.
+ */
+const char *
+intern_str(const char *str) {
+	if (!str) return NULL;
+	if (!interned_pool.next_size)
+		pool_init(&interned_pool);
+	const char *interned = strmap_get(&interned_strings, str);
+	if (interned)
+		return interned;
+	size_t len = strlen(str);
+	char *copy = pool_alloc(&interned_pool, len+1);
+	memcpy(copy, str, len+1);
+	strmap_add(&interned_strings, copy, copy);
+	return copy;
+}
+
+/**
+ * Get the number of bytes held by the interned strings and their lookup table.
+ */
+size_t
+intern_str_get_size(void) {
+	return pool_get_size(&interned_pool) + interned_strings.capacity * sizeof(strmap_slot_t);
+}
+
+
 void
 ref(void *ptr) {
 	assert(ptr);
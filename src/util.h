@@ -4,7 +4,13 @@
 
 
 typedef struct array array_t;
+typedef struct pool pool_t;
+typedef struct pool_slab pool_slab_t;
 typedef struct ptrset ptrset_t;
+typedef struct strmap strmap_t;
+typedef struct strmap_slot strmap_slot_t;
+typedef struct intmap intmap_t;
+typedef struct intmap_slot intmap_slot_t;
 
 
 /**
@@ -74,15 +80,120 @@ void ptrset_dispose(ptrset_t*);
 bool ptrset_add(ptrset_t*, void*);
 bool ptrset_remove(ptrset_t*, void*);
 bool ptrset_contains(ptrset_t*, void*);
+bool ptrset_find(ptrset_t*, void*, size_t*);
 /** @} */
 
 
 
+/**
+ * @defgroup hashmap Hash Maps
+ * @{
+ *
+ * Hash maps from strings and integers to non-`NULL` pointers, using open
+ * addressing with linear probing. Keys are not copied; a string key must
+ * remain valid for as long as it is in the map. Each key maps to at most one
+ * value.
+ */
+struct strmap_slot {
+	/// The hash of the key.
+	uint32_t hash;
+	/// The key, or `NULL` if the slot is empty.
+	const char *key;
+	void *value;
+};
+
+struct strmap {
+	/// The number of keys in the map.
+	size_t size;
+	/// The number of slots. Always zero or a power of two.
+	size_t capacity;
+	strmap_slot_t *slots;
+};
+
+struct intmap_slot {
+	uint32_t key;
+	/// The value, or `NULL` if the slot is empty.
+	void *value;
+};
+
+struct intmap {
+	/// The number of keys in the map.
+	size_t size;
+	/// The number of slots. Always zero or a power of two.
+	size_t capacity;
+	intmap_slot_t *slots;
+};
+
+void strmap_init(strmap_t*);
+void strmap_dispose(strmap_t*);
+void *strmap_get(strmap_t*, const char*);
+bool strmap_add(strmap_t*, const char*, void*);
+void *strmap_remove(strmap_t*, const char*);
+
+void intmap_init(intmap_t*);
+void intmap_dispose(intmap_t*);
+void *intmap_get(intmap_t*, uint32_t);
+bool intmap_add(intmap_t*, uint32_t, void*);
+void *intmap_remove(intmap_t*, uint32_t);
+/** @} */
+
+
+/**
+ * @defgroup pool Memory Pool
+ * @{
+ *
+ * A slab allocator for many small objects that share a lifetime. Objects are
+ * carved from slabs in allocation order, such that objects allocated in
+ * sequence lie next to each other in memory. Freed objects are kept on a free
+ * list per size class and reused by later allocations of the same size.
+ * Disposing of the pool releases all slabs at once.
+ */
+/// The granularity of allocation sizes, in bytes.
+#define POOL_GRANULE 8
+/// The number of size classes with a free list. Larger objects are not reused.
+#define POOL_NUM_CLASSES 32
+/// The size of the first slab allocated by a pool.
+#define POOL_MIN_SLAB 256
+/// The size beyond which slabs are no longer doubled.
+#define POOL_MAX_SLAB 65536
+
+struct pool_slab {
+	/// The slab allocated before this one.
+	pool_slab_t *next;
+	/// The number of bytes in the slab, excluding this header.
+	size_t size;
+};
+
+struct pool {
+	/// The most recently allocated slab.
+	pool_slab_t *slabs;
+	/// The unused region of the most recently allocated slab.
+	char *ptr;
+	char *end;
+	/// The size of the next slab to be allocated.
+	size_t next_size;
+	/// The free lists of each size class.
+	void *free[POOL_NUM_CLASSES];
+};
+
+void pool_init(pool_t*);
+void pool_dispose(pool_t*);
+void *pool_alloc(pool_t*, size_t);
+void *pool_calloc(pool_t*, size_t);
+void pool_free(pool_t*, void*, size_t);
+size_t pool_get_size(pool_t*);
+/** @} */
+
+
 /* String and memory duplication */
 char *dupstr(const char *src);
 char *dupstrn(const char *src, size_t len);
 void *dupmem(const void *src, size_t len);
 
+/* String interning */
+const char *intern_str(const char *str);
+size_t intern_str_get_size(void);
+
 
 /* Reference counting */
 void ref(void*);